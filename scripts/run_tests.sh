@@ -36,4 +36,58 @@ for input_file in ../inputs/*.x25a; do
     echo ""
 done
 
+# Run programs through the interpreter and compare their output byte for byte.
+# Inputs and expected outputs are printf formats; -b reads and writes 8-byte
+# little-endian values
+failed=0
+check_run() {
+    name=$1; flags=$2; input=$3; expected=$4
+    actual=$(printf "$input" | ./interp $flags "../test-outputs/${name}.lex" | od -An -tx1)
+    if [ "$actual" = "$(printf "$expected" | od -An -tx1)" ]; then
+        echo "  Run passed for $name${flags:+ $flags}"
+    else
+        echo "  Run failed for $name${flags:+ $flags}"
+        failed=1
+    fi
+}
+
+echo "Running programs..."
+check_run first  ""   '5\n'   '120\n'
+check_run first  ""   '1\n'   ''
+check_run second ""   '3 7\n' '7\n'
+check_run second ""   '4 4\n' 'iguais\n'
+check_run first  "-b" '\005\0\0\0\0\0\0\0' 'x\0\0\0\0\0\0\0'
+check_run second "-b" '\011\0\0\0\0\0\0\0\002\0\0\0\0\0\0\0' '\011\0\0\0\0\0\0\0'
+echo ""
+
+# The optimizer must not change what a program does: compare -O0 against the
+# default level on a few inputs, output and exit status both (the pc in
+# runtime errors is left out, it differs between the two)
+echo "Comparing optimized runs..."
+./lexer ../src/input.x25a > ../test-outputs/input.lex 2>/dev/null
+for source in ../inputs/*.x25a ../src/input.x25a; do
+    name=$(basename "$source" .x25a)
+    lex_file="../test-outputs/${name}.lex"
+    if ! ./interp -d "$lex_file" > /dev/null 2>&1; then
+        echo "  Skipped $name, it does not compile"
+        continue
+    fi
+    same=1
+    for input in '5\n' '3 7\n' '4 4 0\n' '1 2 9 0\n' '7 -3 12 0\n'; do
+        plain=$(printf "$input" | timeout 5 ./interp -O0 "$lex_file" 2>&1; echo "exit $?")
+        plain=$(echo "$plain" | sed 's/, pc [0-9]*)/)/')
+        optimized=$(printf "$input" | timeout 5 ./interp "$lex_file" 2>&1; echo "exit $?")
+        optimized=$(echo "$optimized" | sed 's/, pc [0-9]*)/)/')
+        [ "$plain" = "$optimized" ] || same=0
+    done
+    if [ $same -eq 1 ]; then
+        echo "  Optimized run matches for $name"
+    else
+        echo "  Optimized run differs for $name"
+        failed=1
+    fi
+done
+echo ""
+
 echo "Testing complete. Results are in test-outputs/"
+exit $failed
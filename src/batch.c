@@ -0,0 +1,336 @@
+// batch.c
+// Data-parallel execution: runs one program over many independent input
+// lines, BATCH_LANES instances at a time in lockstep. Every variable holds
+// one value per lane and arithmetic works on whole vectors; SE and ENQUANTO
+// run under lane masks, and a lane drops out of a FAÇA loop as soon as its
+// own condition fails. Vectors use GCC vector extensions, so the same code
+// becomes AVX2 or SSE2 on x86-64 (picked at run time) and plain scalar
+// loops elsewhere.
+//
+// Input:  one line per instance, with the values its LEIA statements read.
+// Output: one line per instance, its ESCREVA items separated by spaces.
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "interp.h"
+
+#define BATCH_LANES 16
+
+typedef int64_t svec __attribute__((vector_size(BATCH_LANES * sizeof(int64_t))));
+typedef uint64_t uvec __attribute__((vector_size(BATCH_LANES * sizeof(int64_t))));
+
+#if defined(__x86_64__)
+#define SIMD_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define SIMD_CLONES
+#endif
+
+// Expressions are flattened to postfix so evaluation is one loop, not a tree walk
+typedef struct {
+    int kind;       // NodeKind of the operation
+    int var;
+    Value num;
+} BOp;
+
+typedef struct {
+    BOp* ops;
+    int n;
+} BExpr;
+
+typedef struct {
+    char* data;
+    size_t len, cap;
+} Text;
+
+typedef struct {
+    const Program* prog;
+    BExpr* exprs;           // per statement: assigned value or condition
+    int max_depth;
+
+    svec* vars;
+    svec* stack;
+    svec alive;             // lanes still running (not finished, no runtime error)
+    int base;               // instance number of lane 0
+    const char* cursor[BATCH_LANES];
+    const char* line_end[BATCH_LANES];
+    Text outs[BATCH_LANES];
+    int errors;
+} Batch;
+
+static int any(const svec* m) {
+    int64_t r = 0;
+    for(int l = 0; l < BATCH_LANES; l++) r |= (*m)[l];
+    return r != 0;
+}
+
+// Lane masks (0 / -1) from plain arithmetic: GCC splits wide vector compares
+// into one scalar compare per lane, but shifts and adds stay vector ops.
+static inline void lt_mask(svec* r, const svec* a, const svec* b) {
+    uvec d = (uvec)*a - (uvec)*b;
+    uvec ovf = ((uvec)*a ^ (uvec)*b) & (d ^ (uvec)*a);   // signed overflow flips the sign
+    *r = (svec)(-((d ^ ovf) >> 63));
+}
+
+static inline void eq_mask(svec* r, const svec* a, const svec* b) {
+    uvec x = (uvec)*a ^ (uvec)*b;
+    *r = (svec)(((x | -x) >> 63) - 1);
+}
+
+// Conditions give 0 / -1 from LT and EQ, but the optimizer may have folded
+// one to a plain constant, so any nonzero value counts as true
+static void truth_mask(svec* c) {
+    svec zero = {0};
+    eq_mask(c, c, &zero);
+    *c = ~*c;
+}
+
+static void flatten(BExpr* e, const Node* n, int depth, int* max_depth) {
+    if(n->kind != N_NUM && n->kind != N_VAR){
+        flatten(e, n->a, depth, max_depth);
+        flatten(e, n->b, depth + 1, max_depth);
+    } else if(depth + 1 > *max_depth) {
+        *max_depth = depth + 1;
+    }
+    e->ops = realloc(e->ops, sizeof(BOp) * (e->n + 1));
+    if(!e->ops){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+    e->ops[e->n++] = (BOp){ .kind = n->kind, .var = n->var, .num = n->num };
+}
+
+static void flatten_stmts(Batch* b, const Node* n) {
+    for(; n; n = n->next){
+        if(n->a) flatten(&b->exprs[n->id], n->a, 0, &b->max_depth);
+        flatten_stmts(b, n->body);
+        flatten_stmts(b, n->alt);
+    }
+}
+
+static void lane_error(Batch* b, int lane, const char* msg, int stmt) {
+    fprintf(stderr, "RUNTIME ERROR: %s (instance #%d, statement #%d)\n", msg, b->base + lane + 1, stmt + 1);
+    b->alive[lane] = 0;
+    b->errors++;
+}
+
+// Evaluates `e` for every lane into stack[0]; lanes outside `mask` compute
+// garbage but can never trap. Lanes in `mask` that divide by zero are
+// returned in *fail. Vectors go by pointer to keep them out of the call ABI.
+SIMD_CLONES
+static void eval(const BExpr* e, const svec* vars, svec* stack, const svec* mask, svec* fail) {
+    svec* sp = stack;
+    svec zero = {0};
+    *fail = zero;
+    for(int i = 0; i < e->n; i++){
+        const BOp* op = &e->ops[i];
+        switch(op->kind){
+            case N_NUM: *sp++ = zero + op->num; break;
+            case N_VAR: *sp++ = vars[op->var]; break;
+            case N_ADD: sp--; sp[-1] = (svec)((uvec)sp[-1] + (uvec)sp[0]); break;
+            case N_SUB: sp--; sp[-1] = (svec)((uvec)sp[-1] - (uvec)sp[0]); break;
+            case N_MUL: sp--; sp[-1] = (svec)((uvec)sp[-1] * (uvec)sp[0]); break;
+            case N_LT: sp--; lt_mask(&sp[-1], &sp[-1], &sp[0]); break;
+            case N_EQ: sp--; eq_mask(&sp[-1], &sp[-1], &sp[0]); break;
+            case N_DIV: {
+                // no SIMD integer division; keep inactive and failing lanes away from it
+                sp--;
+                svec num = sp[-1], den = sp[0], minus1 = zero - 1;
+                svec by_zero, by_minus1;
+                eq_mask(&by_zero, &den, &zero);
+                eq_mask(&by_minus1, &den, &minus1);
+                *fail |= *mask & by_zero;
+                svec safe = by_zero | by_minus1;
+                den = (safe & 1) | (~safe & den);
+                svec q = num / den;
+                svec neg = (svec)(-(uvec)num);
+                sp[-1] = (by_minus1 & neg) | (~by_minus1 & q);
+                break;
+            }
+            default: break;
+        }
+    }
+}
+
+// Evaluates statement `stmt`'s expression into b->stack[0]
+static void eval_checked(Batch* b, int stmt, const svec* mask) {
+    svec fail;
+    eval(&b->exprs[stmt], b->vars, b->stack, mask, &fail);
+    if(any(&fail)){
+        for(int l = 0; l < BATCH_LANES; l++)
+            if(fail[l]) lane_error(b, l, "division by zero", stmt);
+    }
+}
+
+static void text_append(Text* t, const char* s, size_t n) {
+    if(t->len + n + 1 > t->cap){
+        size_t cap = t->cap ? t->cap : 64;
+        while(cap < t->len + n + 1) cap *= 2;
+        t->data = realloc(t->data, cap);
+        if(!t->data){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+        t->cap = cap;
+    }
+    if(t->len > 0) t->data[t->len++] = ' ';
+    memcpy(t->data + t->len, s, n);
+    t->len += n;
+}
+
+// LEIA for one lane: the next integer on its input line, 0 at end of line
+static int lane_read(Batch* b, int l, Value* v) {
+    const char* p = b->cursor[l];
+    const char* end = b->line_end[l];
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    if(p == end){
+        b->cursor[l] = p;
+        *v = 0;
+        return 1;
+    }
+    const char* q = p;
+    while(q < end && *q != ' ' && *q != '\t' && *q != '\r') q++;
+    if(rt_parse_value(p, q, v) < 0) return 0;
+    b->cursor[l] = q;
+    return 1;
+}
+
+static void exec(Batch* b, const Node* n, const svec* active) {
+    svec mask = *active;
+    for(; n; n = n->next){
+        mask &= b->alive;
+        if(!any(&mask)) return;
+
+        switch(n->kind){
+            case N_ASSIGN: {
+                eval_checked(b, n->id, &mask);
+                mask &= b->alive;
+                b->vars[n->var] = (mask & b->stack[0]) | (~mask & b->vars[n->var]);
+                break;
+            }
+            case N_READ:
+                for(int l = 0; l < BATCH_LANES; l++){
+                    if(!mask[l]) continue;
+                    Value v;
+                    if(lane_read(b, l, &v)) b->vars[n->var][l] = v;
+                    else lane_error(b, l, "malformed input value", n->id);
+                }
+                break;
+            case N_WRITE_VAR:
+                for(int l = 0; l < BATCH_LANES; l++){
+                    if(!mask[l]) continue;
+                    char tmp[24];
+                    int len = snprintf(tmp, sizeof(tmp), "%lld", (long long)b->vars[n->var][l]);
+                    text_append(&b->outs[l], tmp, len);
+                }
+                break;
+            case N_WRITE_STR: {
+                const char* s = b->prog->strs[n->str];
+                size_t len = strlen(s);
+                for(int l = 0; l < BATCH_LANES; l++)
+                    if(mask[l]) text_append(&b->outs[l], s, len);
+                break;
+            }
+            case N_IF: {
+                eval_checked(b, n->id, &mask);
+                truth_mask(&b->stack[0]);
+                mask &= b->alive;
+                svec t = mask & b->stack[0], e = mask & ~b->stack[0];
+                if(any(&t)) exec(b, n->body, &t);
+                if(n->alt && any(&e)) exec(b, n->alt, &e);
+                break;
+            }
+            case N_DO_WHILE: {
+                svec m = mask;
+                do {
+                    exec(b, n->body, &m);
+                    m &= b->alive;
+                    if(!any(&m)) break;
+                    eval_checked(b, n->id, &m);
+                    truth_mask(&b->stack[0]);
+                    m &= b->stack[0] & b->alive;
+                } while(any(&m));
+                break;
+            }
+            default: break;
+        }
+    }
+}
+
+static char* slurp_fd(int fd, size_t* len, int* mapped) {
+    struct stat st;
+    *mapped = 0;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+        void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(m != MAP_FAILED){
+            *mapped = 1;
+            *len = st.st_size;
+            return m;
+        }
+    }
+    size_t cap = 1 << 16;
+    char* data = malloc(cap);
+    *len = 0;
+    for(;;){
+        if(!data) return NULL;
+        if(*len == cap) data = realloc(data, cap *= 2);
+        if(!data) return NULL;
+        ssize_t n = read(fd, data + *len, cap - *len);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) break;
+        *len += n;
+    }
+    return data;
+}
+
+int batch_run(const Program* p, int in_fd, RtOut* out) {
+    Batch b;
+    memset(&b, 0, sizeof(b));
+    b.prog = p;
+    b.exprs = calloc(p->nstmts ? p->nstmts : 1, sizeof(BExpr));
+    flatten_stmts(&b, p->ast);
+    // vectors need their natural alignment, which malloc does not promise
+    b.vars = aligned_alloc(sizeof(svec), sizeof(svec) * (p->nvars ? p->nvars : 1));
+    b.stack = aligned_alloc(sizeof(svec), sizeof(svec) * (b.max_depth ? b.max_depth : 1));
+
+    size_t len;
+    int mapped;
+    char* input = slurp_fd(in_fd, &len, &mapped);
+    if(!b.exprs || !b.vars || !b.stack || !input){
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+
+    const char* pos = input;
+    const char* end = input + len;
+    while(pos < end){
+        svec zero = {0};
+        memset(b.vars, 0, sizeof(svec) * (p->nvars ? p->nvars : 1));
+        b.alive = zero;
+
+        int lanes = 0;
+        while(lanes < BATCH_LANES && pos < end){
+            const char* nl = memchr(pos, '\n', end - pos);
+            if(!nl) nl = end;
+            b.cursor[lanes] = pos;
+            b.line_end[lanes] = nl;
+            b.outs[lanes].len = 0;
+            b.alive[lanes] = -1;
+            lanes++;
+            pos = (nl < end) ? nl + 1 : end;
+        }
+
+        svec all = b.alive;
+        exec(&b, p->ast, &all);
+
+        for(int l = 0; l < lanes; l++) rt_write_str(out, b.outs[l].data ? b.outs[l].data : "", b.outs[l].len);
+        b.base += lanes;
+    }
+
+    if(mapped) munmap(input, len);
+    else free(input);
+    for(int i = 0; i < p->nstmts; i++) free(b.exprs[i].ops);
+    for(int l = 0; l < BATCH_LANES; l++) free(b.outs[l].data);
+    free(b.exprs);
+    free(b.vars);
+    free(b.stack);
+    return b.errors ? 1 : 0;
+}
@@ -0,0 +1,45 @@
+// check.c
+// Runs the lexer and parser over an in-memory buffer, the way
+// `./lexer f.x25a > f.lex && ./parser f.lex` does, without temp files
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+void check_source(const char* src, size_t len, CheckResult* r) {
+    memset(r, 0, sizeof(*r));
+    r->status = CHECK_FAILED;
+
+    FILE* diag = open_memstream(&r->diag, &r->diag_len);
+    FILE* toks = open_memstream(&r->tokens, &r->tokens_len);
+    char* report_buf = NULL;     // parser banners, not part of the result
+    size_t report_len = 0;
+    FILE* report = open_memstream(&report_buf, &report_len);
+    FILE* in = fmemopen((void*)src, len, "r");
+    if(!diag || !toks || !report || !in) goto done;
+
+    r->lex_errors = lex_stream(in, toks, diag);
+    fflush(toks);
+
+    FILE* tin = fmemopen(r->tokens, r->tokens_len, "r");
+    if(!tin) goto done;
+    r->parse_errors = parse_stream(tin, report, diag);
+    fclose(tin);
+
+    if(r->parse_errors < 0) r->status = CHECK_FAILED;
+    else r->status = (r->lex_errors || r->parse_errors) ? CHECK_ERRORS : CHECK_OK;
+
+done:
+    if(in) fclose(in);
+    if(report) fclose(report);
+    free(report_buf);
+    if(toks) fclose(toks);
+    if(diag) fclose(diag);
+}
+
+void check_result_free(CheckResult* r) {
+    free(r->diag);
+    free(r->tokens);
+    r->diag = r->tokens = NULL;
+}
@@ -0,0 +1,30 @@
+// check.h
+// In-process lexer + parser pass over X25a source text
+
+#ifndef X25A_CHECK_H
+#define X25A_CHECK_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Provided by lexer.c and parser.c when built with -DX25A_NO_MAIN
+int lex_stream(FILE* f, FILE* out, FILE* diag);
+int parse_stream(FILE* tokens, FILE* out, FILE* diag);
+
+typedef enum { CHECK_OK = 0, CHECK_ERRORS = 1, CHECK_FAILED = 2 } CheckStatus;
+
+typedef struct {
+    CheckStatus status;
+    int lex_errors;
+    int parse_errors;
+    char* diag;         // lexer and parser diagnostics, as printed on stderr
+    size_t diag_len;
+    char* tokens;       // lexer output, as written by ./lexer
+    size_t tokens_len;
+} CheckResult;
+
+// Lexes and parses `len` bytes of source. Safe to call from several threads.
+void check_source(const char* src, size_t len, CheckResult* r);
+void check_result_free(CheckResult* r);
+
+#endif
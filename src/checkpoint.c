@@ -0,0 +1,296 @@
+// checkpoint.c
+// Snapshots of a running VM, so a long job can be resumed after a crash.
+//
+// A snapshot holds the variable frame, pc and stack, the input and output
+// offsets and a hash of the program image, in a small file:
+//
+//   CkptHeader | Value vars[nvars] | Value stack[sp] | u64 FNV-1a of all before
+//
+// The VM thread only flushes its output and copies the frame; a writer
+// thread syncs the output, writes `path.tmp`, fsyncs it and renames it over
+// `path`, so the file on disk is always a complete snapshot whose output is
+// durable. If the writer is still busy, a newer snapshot replaces the queued one.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "interp.h"
+
+#define CKPT_MAGIC "X25ACKP1"
+
+typedef struct {
+    char magic[8];
+    uint64_t prog_hash;
+    int64_t in_off, out_off;
+    int64_t steps;
+    int32_t pc, sp;
+    int32_t nvars, binary;
+} CkptHeader;
+
+struct Checkpointer {
+    char* path;
+    char* tmp;
+    int out_fd;
+    uint64_t prog_hash;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned char* pending;     // snapshot waiting for the writer
+    size_t pending_len;
+    int stop;
+    int failed;                 // last write failed, already reported
+    long long written;          // snapshots on disk
+};
+
+static uint64_t fnv1a(uint64_t h, const void* data, size_t n) {
+    const unsigned char* p = data;
+    for(size_t i = 0; i < n; i++){
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+#define FNV_INIT 1469598103934665603ull
+
+// Field by field, so the hash does not depend on struct padding
+uint64_t program_hash(const Program* p) {
+    uint64_t h = FNV_INIT;
+    int32_t n = p->nvars;
+    h = fnv1a(h, &n, sizeof(n));
+    for(int i = 0; i < p->ncode; i++){
+        const Instr* in = &p->code[i];
+        h = fnv1a(h, &in->op, sizeof(in->op));
+        h = fnv1a(h, &in->arg, sizeof(in->arg));
+    }
+    for(int i = 0; i < p->nstrs; i++) h = fnv1a(h, p->strs[i], strlen(p->strs[i]) + 1);
+    return h;
+}
+
+static int write_all(int fd, const unsigned char* p, size_t n) {
+    while(n > 0){
+        ssize_t w = write(fd, p, n);
+        if(w < 0){
+            if(errno == EINTR) continue;
+            return 0;
+        }
+        p += w;
+        n -= w;
+    }
+    return 1;
+}
+
+static int read_all(int fd, unsigned char* p, size_t n) {
+    while(n > 0){
+        ssize_t r = read(fd, p, n);
+        if(r < 0){
+            if(errno == EINTR) continue;
+            return 0;
+        }
+        if(r == 0) return 0;
+        p += r;
+        n -= r;
+    }
+    return 1;
+}
+
+// tmp + fsync + rename + fsync of the directory
+static int write_snapshot(Checkpointer* c, const unsigned char* data, size_t len) {
+    struct stat st;
+    if(fstat(c->out_fd, &st) == 0 && S_ISREG(st.st_mode) && fdatasync(c->out_fd) < 0) return 0;
+
+    int fd = open(c->tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0) return 0;
+    if(!write_all(fd, data, len) || fsync(fd) < 0){
+        close(fd);
+        unlink(c->tmp);
+        return 0;
+    }
+    close(fd);
+    if(rename(c->tmp, c->path) < 0) return 0;
+
+    char* dir = strdup(c->path);
+    if(!dir) return 1;
+    char* slash = strrchr(dir, '/');
+    if(slash) *(slash == dir ? slash + 1 : slash) = 0;
+    int dfd = open(slash ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dfd >= 0){
+        fsync(dfd);
+        close(dfd);
+    }
+    free(dir);
+    return 1;
+}
+
+static void* writer(void* arg) {
+    Checkpointer* c = arg;
+    pthread_mutex_lock(&c->lock);
+    for(;;){
+        while(!c->pending && !c->stop) pthread_cond_wait(&c->cond, &c->lock);
+        if(!c->pending) break;
+        unsigned char* data = c->pending;
+        size_t len = c->pending_len;
+        c->pending = NULL;
+        pthread_mutex_unlock(&c->lock);
+
+        int ok = write_snapshot(c, data, len);
+        if(!ok && !c->failed){
+            fprintf(stderr, "Error: Cannot write checkpoint '%s'\n", c->path);
+            perror("checkpoint");
+        }
+        free(data);
+
+        pthread_mutex_lock(&c->lock);
+        c->failed = !ok;
+        c->written += ok;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+Checkpointer* ckpt_start(const char* path, const Program* p, int out_fd) {
+    Checkpointer* c = calloc(1, sizeof(Checkpointer));
+    if(!c) return NULL;
+    c->path = strdup(path);
+    c->tmp = malloc(strlen(path) + 5);
+    if(!c->path || !c->tmp){
+        free(c->path);
+        free(c->tmp);
+        free(c);
+        return NULL;
+    }
+    sprintf(c->tmp, "%s.tmp", path);
+    c->out_fd = out_fd;
+    c->prog_hash = program_hash(p);
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->cond, NULL);
+    if(pthread_create(&c->thread, NULL, writer, c) != 0){
+        free(c->path);
+        free(c->tmp);
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+void ckpt_save(Checkpointer* c, VM* vm) {
+    const Program* p = vm->prog;
+    // the snapshot points past everything written so far, so it must be in the file
+    rt_flush(vm->out);
+
+    size_t len = sizeof(CkptHeader) + sizeof(Value) * (p->nvars + vm->sp) + sizeof(uint64_t);
+    unsigned char* data = malloc(len);
+    if(!data) return;   // skip this one, the next interval tries again
+
+    CkptHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CKPT_MAGIC, sizeof(h.magic));
+    h.prog_hash = c->prog_hash;
+    h.in_off = rt_in_offset(vm->in);
+    h.out_off = rt_out_offset(vm->out);
+    h.steps = vm->steps;
+    h.pc = vm->pc;
+    h.sp = vm->sp;
+    h.nvars = p->nvars;
+    h.binary = vm->in->binary;
+
+    unsigned char* q = data;
+    memcpy(q, &h, sizeof(h));
+    q += sizeof(h);
+    memcpy(q, vm->vars, sizeof(Value) * p->nvars);
+    q += sizeof(Value) * p->nvars;
+    memcpy(q, vm->stack, sizeof(Value) * vm->sp);
+    q += sizeof(Value) * vm->sp;
+    uint64_t sum = fnv1a(FNV_INIT, data, q - data);
+    memcpy(q, &sum, sizeof(sum));
+
+    pthread_mutex_lock(&c->lock);
+    free(c->pending);
+    c->pending = data;
+    c->pending_len = len;
+    pthread_cond_signal(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+}
+
+// Writes whatever is queued and stops the writer. Returns snapshots written.
+long long ckpt_stop(Checkpointer* c) {
+    pthread_mutex_lock(&c->lock);
+    c->stop = 1;
+    pthread_cond_signal(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->thread, NULL);
+
+    long long n = c->written;
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->cond);
+    free(c->path);
+    free(c->tmp);
+    free(c);
+    return n;
+}
+
+static int load_error(const char* path, const char* msg) {
+    fprintf(stderr, "Error: checkpoint '%s' %s\n", path, msg);
+    return 0;
+}
+
+int ckpt_load(const char* path, VM* vm, int binary, long long* in_off, long long* out_off) {
+    const Program* p = vm->prog;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        fprintf(stderr, "Error: Cannot open '%s'\n", path);
+        perror("open");
+        return 0;
+    }
+    struct stat st;
+    unsigned char* data = NULL;
+    size_t len = 0;
+    if(fstat(fd, &st) == 0 && st.st_size >= (off_t)(sizeof(CkptHeader) + sizeof(uint64_t))){
+        len = st.st_size;
+        data = malloc(len);
+        if(data && !read_all(fd, data, len)){
+            free(data);
+            data = NULL;
+        }
+    }
+    close(fd);
+    if(!data) return load_error(path, "is truncated or unreadable");
+
+    CkptHeader h;
+    memcpy(&h, data, sizeof(h));
+    uint64_t sum;
+    memcpy(&sum, data + len - sizeof(sum), sizeof(sum));
+    int ok = 0;
+    if(memcmp(h.magic, CKPT_MAGIC, sizeof(h.magic)) != 0)
+        load_error(path, "is not a checkpoint file");
+    else if(fnv1a(FNV_INIT, data, len - sizeof(sum)) != sum)
+        load_error(path, "is corrupt (checksum mismatch)");
+    else if(h.prog_hash != program_hash(p) || h.nvars != p->nvars)
+        load_error(path, "was taken from a different program (or compiled with different options)");
+    else if(h.binary != binary)
+        load_error(path, binary ? "was taken in text mode, run without -b" : "was taken in binary mode, run with -b");
+    else if(h.pc < 0 || h.pc >= p->ncode || h.sp < 0 || h.sp > p->max_stack ||
+            len != sizeof(h) + sizeof(Value) * (h.nvars + h.sp) + sizeof(sum))
+        load_error(path, "is corrupt (bad frame)");
+    else
+        ok = 1;
+
+    if(ok){
+        const unsigned char* q = data + sizeof(h);
+        memcpy(vm->vars, q, sizeof(Value) * h.nvars);
+        memcpy(vm->stack, q + sizeof(Value) * h.nvars, sizeof(Value) * h.sp);
+        vm->pc = h.pc;
+        vm->sp = h.sp;
+        vm->steps = h.steps;
+        *in_off = h.in_off;
+        *out_off = h.out_off;
+    }
+    free(data);
+    return ok;
+}
@@ -0,0 +1,122 @@
+// client.c
+// Thin client for ./server: sends files to be checked and prints the
+// diagnostics, like running ./lexer and ./parser on each file
+// Usage: ./client [-s] [-t] socket-path file...
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "proto.h"
+
+static int send_request(int fd, char kind, int flags, const char* payload, size_t n) {
+    uint32_t len = (uint32_t)(n + 2);
+    char hdr[6];
+    memcpy(hdr, &len, 4);
+    hdr[4] = kind;
+    hdr[5] = (char)flags;
+    return proto_write_all(fd, hdr, sizeof(hdr)) && proto_write_all(fd, payload, n);
+}
+
+static char* slurp(const char* path, size_t* n) {
+    FILE* f = fopen(path, "rb");
+    if(!f) return NULL;
+    char* data = NULL;
+    size_t cap = 0;
+    *n = 0;
+    for(;;){
+        if(*n == cap){
+            cap = cap ? cap * 2 : 4096;
+            char* p = realloc(data, cap);
+            if(!p){ free(data); fclose(f); return NULL; }
+            data = p;
+        }
+        size_t r = fread(data + *n, 1, cap - *n, f);
+        if(r == 0) break;
+        *n += r;
+    }
+    fclose(f);
+    return data;
+}
+
+int main(int argc, char** argv){
+    int send_text = 0, flags = 0;
+    int opt;
+    while((opt = getopt(argc, argv, "st")) != -1){
+        switch(opt){
+            case 's': send_text = 1; break;
+            case 't': flags |= PROTO_WANT_TOKENS; break;
+            default: goto usage;
+        }
+    }
+    if(argc - optind < 2) goto usage;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, argv[optind], sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0){
+        fprintf(stderr, "Error: Cannot connect to '%s'\n", argv[optind]);
+        perror("connect");
+        return 2;
+    }
+
+    int worst = 0;
+    char* resp = NULL;
+    for(int i = optind + 1; i < argc; i++){
+        int ok;
+        if(send_text){
+            size_t n;
+            char* src = slurp(argv[i], &n);
+            if(!src){
+                fprintf(stderr, "Error: Cannot open '%s'\n", argv[i]);
+                worst = 2;
+                continue;
+            }
+            ok = send_request(fd, PROTO_SOURCE, flags, src, n);
+            free(src);
+        } else {
+            // the server has its own working directory
+            char path[PATH_MAX];
+            if(!realpath(argv[i], path)){
+                fprintf(stderr, "Error: Cannot open '%s'\n", argv[i]);
+                worst = 2;
+                continue;
+            }
+            ok = send_request(fd, PROTO_PATH, flags, path, strlen(path));
+        }
+
+        uint32_t len, diag_len;
+        if(!ok || !proto_read_all(fd, &len, 4) || len < 5 || len > PROTO_MAX_MSG){
+            fprintf(stderr, "Error: connection to server lost\n");
+            return 2;
+        }
+        free(resp);
+        resp = malloc(len);
+        if(!resp || !proto_read_all(fd, resp, len)){
+            fprintf(stderr, "Error: connection to server lost\n");
+            return 2;
+        }
+        memcpy(&diag_len, resp + 1, 4);
+        if(diag_len > len - 5) diag_len = len - 5;
+
+        int status = (unsigned char)resp[0];
+        if(diag_len > 0){
+            fprintf(stderr, "── %s\n", argv[i]);
+            fwrite(resp + 5, 1, diag_len, stderr);
+        }
+        if(flags & PROTO_WANT_TOKENS) fwrite(resp + 5 + diag_len, 1, len - 5 - diag_len, stdout);
+        if(status > worst) worst = status;
+    }
+    free(resp);
+    close(fd);
+    return worst;
+
+usage:
+    fprintf(stderr, "Usage: %s [-s] [-t] socket-path file...\n", argv[0]);
+    fprintf(stderr, "  -s: send the source text instead of the file path\n");
+    fprintf(stderr, "  -t: print the token stream of each file on stdout\n");
+    return 2;
+}
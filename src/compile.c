@@ -0,0 +1,454 @@
+// compile.c
+// Builds an AST from a lexer token file and lowers it to stack bytecode.
+// The front-end is strict: it stops at the first syntax error, since only
+// well-formed programs can be executed. Use ./parser for full diagnostics.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interp.h"
+
+typedef enum {
+    T_EOF,
+    T_KW_LEIA, T_KW_ESCREVA, T_KW_SE, T_KW_ENTAO, T_KW_SENAO, T_KW_FIM, T_KW_FACA, T_KW_ENQUANTO,
+    T_ID, T_NUM,
+    T_ASSIGN, T_LT, T_EQ, T_PLUS, T_MINUS, T_TIMES, T_DIV, T_COMMA, T_LPAREN, T_RPAREN,
+    T_STRING,
+    T_ERROR
+} TokenType;
+
+static const char* tok_names[] = {
+    "EOF",
+    "KW_LEIA", "KW_ESCREVA", "KW_SE", "KW_ENTAO", "KW_SENAO", "KW_FIM", "KW_FACA", "KW_ENQUANTO",
+    "ID", "NUM",
+    "ASSIGN", "LT", "EQ", "PLUS", "MINUS", "TIMES", "DIV", "COMMA", "LPAREN", "RPAREN",
+    "STRING"
+};
+
+typedef struct {
+    TokenType type;
+    char lexeme[600];
+    int pos;
+} Token;
+
+static FILE* infile;
+static Token curtok;
+static int token_count;
+static int failed;
+static Program* prog;
+
+static void* xrealloc(void* p, size_t n) {
+    p = realloc(p, n);
+    if(!p){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+    return p;
+}
+
+static TokenType str_to_ttype(const char* s) {
+    for(size_t i = 0; i < sizeof(tok_names)/sizeof(tok_names[0]); i++)
+        if(strcmp(s, tok_names[i]) == 0) return (TokenType)i;
+    return T_ERROR;
+}
+
+// Token lines are "NAME" or "NAME<TAB>lexeme"; the lexeme is kept verbatim
+static void next_token() {
+    char line[sizeof(curtok.lexeme) + 64];
+
+    curtok.lexeme[0] = 0;
+    curtok.pos = ++token_count;
+    do {
+        if(!fgets(line, sizeof(line), infile)){ curtok.type = T_EOF; return; }
+        line[strcspn(line, "\r\n")] = 0;
+    } while(line[0] == 0);
+
+    char* tab = strchr(line, '\t');
+    if(tab){
+        *tab = 0;
+        strncpy(curtok.lexeme, tab + 1, sizeof(curtok.lexeme) - 1);
+        curtok.lexeme[sizeof(curtok.lexeme) - 1] = 0;
+    }
+    curtok.type = str_to_ttype(line);
+}
+
+static void compile_error(const char* msg) {
+    if(!failed){
+        fprintf(stderr, "ERROR: %s (token position %d", msg, curtok.pos);
+        if(curtok.lexeme[0]) fprintf(stderr, ", found '%s'", curtok.lexeme);
+        fprintf(stderr, ")\n");
+    }
+    failed = 1;
+}
+
+static int accept(TokenType t) {
+    if(curtok.type != t) return 0;
+    next_token();
+    return 1;
+}
+
+static void expect(TokenType t, const char* msg) {
+    if(!accept(t)) compile_error(msg);
+}
+
+static int var_slot(const char* name) {
+    for(int i = 0; i < prog->nvars; i++)
+        if(strcmp(prog->vars[i], name) == 0) return i;
+    prog->vars = xrealloc(prog->vars, sizeof(char*) * (prog->nvars + 1));
+    prog->vars[prog->nvars] = strdup(name);
+    return prog->nvars++;
+}
+
+static int str_index(const char* s) {
+    prog->strs = xrealloc(prog->strs, sizeof(char*) * (prog->nstrs + 1));
+    prog->strs[prog->nstrs] = strdup(s);
+    return prog->nstrs++;
+}
+
+static Node* new_node(NodeKind kind) {
+    Node* n = calloc(1, sizeof(Node));
+    if(!n){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+    n->kind = kind;
+    n->tokpos = curtok.pos;
+    return n;
+}
+
+static Node* new_stmt(NodeKind kind) {
+    Node* n = new_node(kind);
+    n->id = prog->nstmts++;
+    return n;
+}
+
+/* --- Parser: tokens -> AST --- */
+static Node* parse_DECL_LIST();
+static Node* parse_EXPR();
+
+static int is_decl_start() {
+    return curtok.type == T_ID || curtok.type == T_KW_LEIA ||
+           curtok.type == T_KW_ESCREVA || curtok.type == T_KW_SE ||
+           curtok.type == T_KW_FACA;
+}
+
+static Node* parse_FACTOR() {
+    Node* n;
+    if(curtok.type == T_NUM){
+        n = new_node(N_NUM);
+        n->num = strtoll(curtok.lexeme, NULL, 10);
+        next_token();
+    } else if(curtok.type == T_ID){
+        n = new_node(N_VAR);
+        n->var = var_slot(curtok.lexeme);
+        next_token();
+    } else if(accept(T_LPAREN)){
+        n = parse_EXPR();
+        expect(T_RPAREN, "Expected ')' in parenthesized expression");
+    } else {
+        compile_error("Expected expression factor (number, identifier, or '(')");
+        n = new_node(N_NUM);
+    }
+    return n;
+}
+
+static Node* parse_TERM() {
+    Node* n = parse_FACTOR();
+    while(!failed && (curtok.type == T_TIMES || curtok.type == T_DIV)){
+        Node* op = new_node(curtok.type == T_TIMES ? N_MUL : N_DIV);
+        next_token();
+        op->a = n;
+        op->b = parse_FACTOR();
+        n = op;
+    }
+    return n;
+}
+
+static Node* parse_EXPR() {
+    Node* n = parse_TERM();
+    while(!failed && (curtok.type == T_PLUS || curtok.type == T_MINUS)){
+        Node* op = new_node(curtok.type == T_PLUS ? N_ADD : N_SUB);
+        next_token();
+        op->a = n;
+        op->b = parse_TERM();
+        n = op;
+    }
+    return n;
+}
+
+static Node* parse_REL_EXPR() {
+    Node* lhs = parse_EXPR();
+    Node* n;
+    if(curtok.type == T_LT) n = new_node(N_LT);
+    else if(curtok.type == T_EQ) n = new_node(N_EQ);
+    else { compile_error("Expected relational operator ('<' or '=')"); return lhs; }
+    next_token();
+    n->a = lhs;
+    n->b = parse_EXPR();
+    return n;
+}
+
+static Node* parse_DECL() {
+    Node* n = NULL;
+    switch(curtok.type){
+        case T_ID:
+            n = new_stmt(N_ASSIGN);
+            n->var = var_slot(curtok.lexeme);
+            next_token();
+            expect(T_ASSIGN, "Expected := in assignment");
+            n->a = parse_EXPR();
+            break;
+        case T_KW_LEIA:
+            n = new_stmt(N_READ);
+            next_token();
+            if(curtok.type == T_ID) n->var = var_slot(curtok.lexeme);
+            expect(T_ID, "Expected identifier in LEIA statement");
+            break;
+        case T_KW_ESCREVA:
+            next_token();
+            if(curtok.type == T_ID){
+                n = new_stmt(N_WRITE_VAR);
+                n->var = var_slot(curtok.lexeme);
+            } else if(curtok.type == T_STRING){
+                n = new_stmt(N_WRITE_STR);
+                n->str = str_index(curtok.lexeme);
+            } else {
+                compile_error("ESCREVA requires identifier or string literal");
+                break;
+            }
+            next_token();
+            break;
+        case T_KW_SE:
+            n = new_stmt(N_IF);
+            next_token();
+            n->a = parse_REL_EXPR();
+            expect(T_KW_ENTAO, "Expected ENTÃO in SE statement");
+            n->body = parse_DECL_LIST();
+            if(accept(T_KW_SENAO)) n->alt = parse_DECL_LIST();
+            expect(T_KW_FIM, "Expected FIM closing SE block");
+            break;
+        case T_KW_FACA:
+            n = new_stmt(N_DO_WHILE);
+            next_token();
+            n->body = parse_DECL_LIST();
+            expect(T_KW_ENQUANTO, "Expected ENQUANTO closing FAÇA loop");
+            n->a = parse_REL_EXPR();
+            break;
+        default:
+            compile_error("Expected declaration (assignment, LEIA, ESCREVA, SE, or FAÇA)");
+            break;
+    }
+    return n;
+}
+
+// DECL_LIST → DECL { ',' DECL } [','], a trailing comma may close a block
+static Node* parse_DECL_LIST() {
+    Node* head = parse_DECL();
+    Node* tail = head;
+    while(!failed && accept(T_COMMA)){
+        if(!is_decl_start()) break;
+        tail->next = parse_DECL();
+        if(tail->next) tail = tail->next;
+    }
+    return head;
+}
+
+/* --- Code generation: AST -> bytecode --- */
+static int code_cap;
+static int depth;
+static int cur_stmt;
+static int profiling;
+
+static int emit(OpCode op, Value arg) {
+    if(prog->ncode == code_cap){
+        code_cap = code_cap ? code_cap * 2 : 64;
+        prog->code = xrealloc(prog->code, sizeof(Instr) * code_cap);
+    }
+    Instr* i = &prog->code[prog->ncode];
+    i->op = op;
+    i->stmt = cur_stmt;
+    i->arg = arg;
+
+    switch(op){
+        case OP_PUSH: case OP_LOAD: depth++; break;
+        case OP_STORE: case OP_JZ: case OP_JNZ: depth--; break;
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_LT: case OP_EQ: depth--; break;
+        default: break;
+    }
+    if(depth > prog->max_stack) prog->max_stack = depth;
+    return prog->ncode++;
+}
+
+static void gen_expr(const Node* n) {
+    static const OpCode binops[] = {
+        [N_ADD] = OP_ADD, [N_SUB] = OP_SUB, [N_MUL] = OP_MUL,
+        [N_DIV] = OP_DIV, [N_LT] = OP_LT, [N_EQ] = OP_EQ
+    };
+    switch(n->kind){
+        case N_NUM: emit(OP_PUSH, n->num); break;
+        case N_VAR: emit(OP_LOAD, n->var); break;
+        default:
+            gen_expr(n->a);
+            gen_expr(n->b);
+            emit(binops[n->kind], 0);
+            break;
+    }
+}
+
+static void gen_stmts(const Node* n) {
+    for(; n; n = n->next){
+        cur_stmt = n->id;
+        if(profiling) emit(OP_PROF_STMT, 0);
+        switch(n->kind){
+            case N_ASSIGN:
+                gen_expr(n->a);
+                emit(OP_STORE, n->var);
+                break;
+            case N_READ: emit(OP_READ, n->var); break;
+            case N_WRITE_VAR: emit(OP_WRITE, n->var); break;
+            case N_WRITE_STR: emit(OP_WRITES, n->str); break;
+            case N_IF: {
+                gen_expr(n->a);
+                int jz = emit(OP_JZ, 0);
+                if(profiling) emit(OP_PROF_BR, 0);
+                gen_stmts(n->body);
+                // when profiling, an empty SENÃO still gets timed
+                if(n->alt || profiling){
+                    cur_stmt = n->id;
+                    if(profiling) emit(OP_PROF_BR_END, 0);
+                    int jmp = emit(OP_JMP, 0);
+                    prog->code[jz].arg = prog->ncode;
+                    if(profiling) emit(OP_PROF_BR, 1);
+                    gen_stmts(n->alt);
+                    cur_stmt = n->id;
+                    if(profiling) emit(OP_PROF_BR_END, 0);
+                    prog->code[jmp].arg = prog->ncode;
+                } else {
+                    prog->code[jz].arg = prog->ncode;
+                }
+                break;
+            }
+            case N_DO_WHILE: {
+                int top = prog->ncode;
+                if(profiling) emit(OP_PROF_ITER, 0);
+                gen_stmts(n->body);
+                cur_stmt = n->id;
+                gen_expr(n->a);
+                emit(OP_JNZ, top);
+                break;
+            }
+            default: break;
+        }
+    }
+}
+
+int compile_program(FILE* tokens, Program* p, int flags) {
+    memset(p, 0, sizeof(*p));
+    prog = p;
+    profiling = (flags & COMPILE_PROFILE) != 0;
+    infile = tokens;
+    token_count = 0;
+    failed = 0;
+    code_cap = 0;
+    depth = 0;
+
+    next_token();
+    p->ast = parse_DECL_LIST();
+    if(!failed && curtok.type != T_EOF)
+        compile_error("Unexpected token after end of program");
+    if(failed) return 0;
+
+    if(flags & COMPILE_OPTIMIZE) optimize_program(p, &p->opt);
+    gen_stmts(p->ast);
+    cur_stmt = p->nstmts;  // HALT belongs to no statement
+    emit(OP_HALT, 0);
+    return 1;
+}
+
+void free_ast(Node* n) {
+    while(n){
+        Node* next = n->next;
+        if(n->a) free_ast(n->a);
+        if(n->b) free_ast(n->b);
+        free_ast(n->body);
+        free_ast(n->alt);
+        free(n);
+        n = next;
+    }
+}
+
+void free_program(Program* p) {
+    free_ast(p->ast);
+    for(int i = 0; i < p->nvars; i++) free(p->vars[i]);
+    for(int i = 0; i < p->nstrs; i++) free(p->strs[i]);
+    free(p->vars);
+    free(p->strs);
+    free(p->code);
+    memset(p, 0, sizeof(*p));
+}
+
+void dump_code(const Program* p, FILE* out) {
+    static const char* names[] = {
+        "HALT", "PUSH", "LOAD", "STORE", "ADD", "SUB", "MUL", "DIV", "LT", "EQ",
+        "JZ", "JNZ", "JMP", "READ", "WRITE", "WRITES",
+        "PSTMT", "PITER", "PBR", "PBREND"
+    };
+    for(int i = 0; i < p->ncode; i++){
+        const Instr* in = &p->code[i];
+        fprintf(out, "%4d  %-6s", i, names[in->op]);
+        switch(in->op){
+            case OP_PUSH: case OP_JZ: case OP_JNZ: case OP_JMP: case OP_PROF_BR:
+                fprintf(out, " %lld", (long long)in->arg); break;
+            case OP_LOAD: case OP_STORE: case OP_READ: case OP_WRITE:
+                fprintf(out, " %s", p->vars[in->arg]); break;
+            case OP_WRITES:
+                fprintf(out, " '%s'", p->strs[in->arg]); break;
+            default: break;
+        }
+        fprintf(out, "\n");
+    }
+}
+
+static int expr_prec(const Node* n) {
+    switch(n->kind){
+        case N_LT: case N_EQ: return 0;
+        case N_ADD: case N_SUB: return 1;
+        case N_MUL: case N_DIV: return 2;
+        default: return 3;
+    }
+}
+
+void print_expr(const Program* p, const Node* n, FILE* out) {
+    static const char* ops[] = {
+        [N_ADD] = "+", [N_SUB] = "-", [N_MUL] = "*", [N_DIV] = "/", [N_LT] = "<", [N_EQ] = "="
+    };
+    switch(n->kind){
+        case N_NUM: fprintf(out, "%lld", (long long)n->num); return;
+        case N_VAR: fprintf(out, "%s", p->vars[n->var]); return;
+        default: break;
+    }
+    // operators are left-associative: parenthesize a right operand of equal precedence
+    int prec = expr_prec(n);
+    int lp = expr_prec(n->a) < prec, rp = expr_prec(n->b) <= prec;
+    if(lp) fprintf(out, "(");
+    print_expr(p, n->a, out);
+    fprintf(out, lp ? ") %s " : " %s ", ops[n->kind]);
+    if(rp) fprintf(out, "(");
+    print_expr(p, n->b, out);
+    if(rp) fprintf(out, ")");
+}
+
+// First line of a statement as it would appear in source
+void print_stmt_head(const Program* p, const Node* n, FILE* out) {
+    switch(n->kind){
+        case N_ASSIGN:
+            fprintf(out, "%s := ", p->vars[n->var]);
+            print_expr(p, n->a, out);
+            break;
+        case N_READ: fprintf(out, "LEIA %s", p->vars[n->var]); break;
+        case N_WRITE_VAR: fprintf(out, "ESCREVA %s", p->vars[n->var]); break;
+        case N_WRITE_STR: fprintf(out, "ESCREVA '%s'", p->strs[n->str]); break;
+        case N_IF:
+            fprintf(out, "SE ");
+            print_expr(p, n->a, out);
+            fprintf(out, " ENTÃO");
+            break;
+        case N_DO_WHILE: fprintf(out, "FAÇA"); break;
+        default: break;
+    }
+}
@@ -0,0 +1,210 @@
+// interp.c
+// Executes an X25a program from a lexer token file
+// Usage: ./interp [-b | -n] [-d] [-p] [-F folded.txt] [-O level] [-s] [-c ckpt [-i secs] [-r]] tokens.lex < input > output
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "interp.h"
+
+#define CKPT_SLICE (1 << 20)    // instructions between looks at the clock
+#define CKPT_INTERVAL 10.0      // seconds
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-b | -n] [-d] [-p] [-F folded.txt] [-O level] [-s] [-c ckpt [-i secs] [-r]] tokens.lex\n", prog);
+    fprintf(stderr, "  tokens.lex: token file generated by lexer\n");
+    fprintf(stderr, "  -b: binary I/O (LEIA/ESCREVA use raw little-endian int64)\n");
+    fprintf(stderr, "  -n: batch mode, every input line is one instance, run side by side in SIMD lanes\n");
+    fprintf(stderr, "  -d: dump the compiled bytecode instead of running it\n");
+    fprintf(stderr, "  -p: profile, print an annotated listing on stderr when done\n");
+    fprintf(stderr, "  -F: profile, write folded stacks for flamegraph tools to a file\n");
+    fprintf(stderr, "  -O: optimization level, 0 runs the program as written (default 1, 0 with -p or -F)\n");
+    fprintf(stderr, "  -s: print optimizer statistics on stderr\n");
+    fprintf(stderr, "  -c: save the program state to a checkpoint file every -i seconds (default %.0f); input and output must be files\n", CKPT_INTERVAL);
+    fprintf(stderr, "  -r: resume from the checkpoint; input must be a file, output a file opened with >>\n");
+}
+
+static long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int is_regular(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// Puts the VM back where the checkpoint was taken: input is read again from
+// the saved offset and output produced after it is cut off
+static int resume(const char* path, VM* vm, int binary) {
+    long long in_off, out_off;
+    if(!ckpt_load(path, vm, binary, &in_off, &out_off)) return 0;
+
+    struct stat st;
+    if(lseek(STDIN_FILENO, in_off, SEEK_SET) != in_off || fstat(STDOUT_FILENO, &st) < 0){
+        perror("lseek");
+        return 0;
+    }
+    if(st.st_size < out_off){
+        fprintf(stderr, "Error: output has %lld bytes but the checkpoint needs %lld, open it with >> instead of >\n",
+                (long long)st.st_size, out_off);
+        return 0;
+    }
+    if(ftruncate(STDOUT_FILENO, out_off) < 0 || lseek(STDOUT_FILENO, out_off, SEEK_SET) < 0){
+        perror("ftruncate");
+        return 0;
+    }
+    return 1;
+}
+
+
+int main(int argc, char** argv){
+    int binary = 0, dump = 0, listing = 0, batch = 0, optimize = -1, stats = 0, restore = 0;
+    const char* folded = NULL;
+    const char* ckpt = NULL;
+    double interval = CKPT_INTERVAL;
+    int opt;
+    while((opt = getopt(argc, argv, "bndpF:O:sc:i:r")) != -1){
+        switch(opt){
+            case 'b': binary = 1; break;
+            case 'n': batch = 1; break;
+            case 'd': dump = 1; break;
+            case 'p': listing = 1; break;
+            case 'F': folded = optarg; break;
+            case 'O': optimize = atoi(optarg); break;
+            case 's': stats = 1; break;
+            case 'c': ckpt = optarg; break;
+            case 'i': interval = atof(optarg); break;
+            case 'r': restore = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if(optind >= argc){ usage(argv[0]); return 1; }
+    if(batch && (binary || listing || folded)){
+        fprintf(stderr, "Error: -n cannot be combined with -b, -p or -F\n");
+        return 1;
+    }
+    if((batch && ckpt) || (restore && !ckpt)){
+        fprintf(stderr, "Error: -c cannot be combined with -n, and -r needs -c\n");
+        return 1;
+    }
+    // a snapshot records file offsets, which mean nothing for a pipe or terminal
+    if(ckpt && (!is_regular(STDIN_FILENO) || !is_regular(STDOUT_FILENO))){
+        fprintf(stderr, "Error: -c needs input and output redirected from and to regular files\n");
+        return 1;
+    }
+
+    FILE* f = fopen(argv[optind], "r");
+    if(!f){
+        fprintf(stderr, "Error: Cannot open '%s'\n", argv[optind]);
+        perror("fopen");
+        return 1;
+    }
+
+    // profiles refer to statements as written unless -O asks otherwise
+    int profiling = listing || folded;
+    if(optimize < 0) optimize = !profiling;
+    Program prog;
+    int ok = compile_program(f, &prog, (profiling ? COMPILE_PROFILE : 0) | (optimize ? COMPILE_OPTIMIZE : 0));
+    fclose(f);
+    if(!ok){
+        fprintf(stderr, "Error: program has syntax errors, run ./parser for details\n");
+        free_program(&prog);
+        return 1;
+    }
+    if(stats && optimize) print_opt_stats(&prog.opt, stderr);
+
+    if(dump){
+        dump_code(&prog, stdout);
+        free_program(&prog);
+        return 0;
+    }
+
+    if(batch){
+        RtOut out;
+        if(!rt_out_open(&out, STDOUT_FILENO, 0, 0)){
+            fprintf(stderr, "Error: out of memory\n");
+            return 1;
+        }
+        int failed = batch_run(&prog, STDIN_FILENO, &out);
+        rt_out_close(&out);
+        free_program(&prog);
+        if(out.error){
+            perror("write");
+            return 1;
+        }
+        return failed;
+    }
+
+    RtIn in;
+    RtOut out;
+    VM vm;
+    if(!vm_init(&vm, &prog, &in, &out)){
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    if(restore && !resume(ckpt, &vm, binary)){
+        vm_free(&vm);
+        free_program(&prog);
+        return 1;
+    }
+    if(!rt_in_open(&in, STDIN_FILENO, binary, 0) || !rt_out_open(&out, STDOUT_FILENO, binary, 0)){
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    in.tie = &out;
+    if(profiling && !(vm.prof = profile_new(&prog))){
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+
+    VmStatus st;
+    if(ckpt){
+        Checkpointer* c = ckpt_start(ckpt, &prog, STDOUT_FILENO);
+        if(!c){
+            fprintf(stderr, "Error: out of memory\n");
+            return 1;
+        }
+        // slices keep the clock out of the dispatch loop; snapshots are
+        // taken between them, where no statement is half done
+        long long next = now_ms() + (long long)(interval * 1000);
+        while((st = vm_run(&vm, CKPT_SLICE)) == VM_YIELD){
+            if(now_ms() < next) continue;
+            ckpt_save(c, &vm);
+            next = now_ms() + (long long)(interval * 1000);
+        }
+        ckpt_stop(c);
+        if(st == VM_DONE) unlink(ckpt);     // nothing left to resume
+    } else {
+        st = vm_run(&vm, 0);
+    }
+
+    rt_out_close(&out);
+    if(vm.prof){
+        if(listing) profile_listing(&prog, vm.prof, stderr);
+        if(folded){
+            FILE* ff = fopen(folded, "w");
+            if(ff){
+                profile_folded(&prog, vm.prof, ff);
+                fclose(ff);
+            } else {
+                fprintf(stderr, "Error: Cannot open '%s'\n", folded);
+                perror("fopen");
+            }
+        }
+        profile_free(vm.prof);
+    }
+    rt_in_close(&in);
+    vm_free(&vm);
+    free_program(&prog);
+
+    if(out.error){
+        perror("write");
+        return 1;
+    }
+    return (st == VM_DONE) ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+// interp.h
+// Shared definitions for the X25a interpreter: AST, bytecode, VM and runtime I/O
+
+#ifndef X25A_INTERP_H
+#define X25A_INTERP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef int64_t Value;
+
+/* --- AST --- */
+typedef enum {
+    // statements
+    N_ASSIGN, N_READ, N_WRITE_VAR, N_WRITE_STR, N_IF, N_DO_WHILE,
+    // expressions
+    N_NUM, N_VAR, N_ADD, N_SUB, N_MUL, N_DIV, N_LT, N_EQ
+} NodeKind;
+
+typedef struct Node {
+    NodeKind kind;
+    int id;             // statement number, in source order (statements only)
+    int tokpos;         // token position of the first token, as reported by the parser
+    int var;            // variable slot (ASSIGN, READ, WRITE_VAR, VAR)
+    int str;            // string pool index (WRITE_STR)
+    Value num;          // constant (NUM)
+    struct Node* a;     // left operand / assigned expression / condition
+    struct Node* b;     // right operand
+    struct Node* body;  // SE then-branch / FAÇA body
+    struct Node* alt;   // SE else-branch (may be NULL)
+    struct Node* next;  // next statement in the same sequence
+} Node;
+
+/* --- Bytecode --- */
+typedef enum {
+    OP_HALT,
+    OP_PUSH,    // push arg
+    OP_LOAD,    // push vars[arg]
+    OP_STORE,   // vars[arg] = pop
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_LT, OP_EQ,
+    OP_JZ,      // if pop == 0 goto arg
+    OP_JNZ,     // if pop != 0 goto arg
+    OP_JMP,     // goto arg
+    OP_READ,    // LEIA vars[arg]
+    OP_WRITE,   // ESCREVA vars[arg]
+    OP_WRITES,  // ESCREVA strs[arg]
+    // instrumentation, only emitted when compiling for profiling
+    OP_PROF_STMT,   // statement `stmt` executed
+    OP_PROF_ITER,   // FAÇA loop `stmt` starts an iteration
+    OP_PROF_BR,     // SE `stmt` enters branch arg (0 = ENTÃO, 1 = SENÃO)
+    OP_PROF_BR_END  // SE `stmt` leaves its branch
+} OpCode;
+
+typedef struct {
+    int32_t op;
+    int32_t stmt;   // id of the statement this instruction belongs to
+    Value arg;
+} Instr;
+
+// Changes made by each pass, summed over all rounds
+typedef struct {
+    int rounds;         // times the pass pipeline ran until nothing changed
+    int propagated;     // variable reads replaced by their known constant value
+    int folded;         // operations computed at compile time
+    int simplified;     // algebraic identities applied (x + 0, x * 1, ...)
+    int dead_branches;  // SE branches and FAÇA loops settled by a constant condition
+    int dead_stores;    // assignments never read, or storing the value already held
+    int hoisted;        // statements and expressions moved out of FAÇA loops
+} OptStats;
+
+typedef struct {
+    Node* ast;
+    int nstmts;
+
+    char** vars;    // slot -> identifier
+    int nvars;
+    char** strs;    // string pool (ESCREVA messages)
+    int nstrs;
+
+    Instr* code;
+    int ncode;
+    int max_stack;
+
+    OptStats opt;   // filled in when compiled with COMPILE_OPTIMIZE
+} Program;
+
+/* --- Runtime I/O --- */
+typedef struct {
+    int fd;
+    unsigned char* buf;
+    size_t pos, len, cap;
+    int binary;             // raw little-endian int64 values instead of text
+    int mapped;             // buf is an mmap of the whole input file
+    int eof;
+    int no_writer;          // a FIFO nobody has opened for writing: read() == 0 is not the end yet
+    struct RtOut* tie;      // flushed before blocking on more input
+    long long offset;       // input offset of buf[0]
+} RtIn;
+
+typedef struct RtOut {
+    int fd;
+    unsigned char* buf;
+    size_t len, cap;
+    int binary;
+    int error;              // a write failed; further output is dropped
+    long long offset;       // output offset where buf starts (bytes already written)
+} RtOut;
+
+#define RT_AGAIN (-2)    // non-blocking input has no complete value yet
+
+// bufsize 0 selects the default (1 MiB) buffers
+int rt_in_open(RtIn* in, int fd, int binary, size_t bufsize);
+void rt_in_close(RtIn* in);
+int rt_read_value(RtIn* in, Value* v);                  // 1 = value, 0 = end of input, -1 = malformed, RT_AGAIN
+int rt_parse_value(const char* p, const char* e, Value* v); // 1 = value, -1 = malformed or out of range
+int rt_out_open(RtOut* out, int fd, int binary, size_t bufsize);
+void rt_out_close(RtOut* out);
+void rt_write_value(RtOut* out, Value v);
+void rt_write_str(RtOut* out, const char* s, size_t n);
+int rt_flush(RtOut* out);
+// Positions of the next byte LEIA consumes and ESCREVA produces
+static inline long long rt_in_offset(const RtIn* in) { return in->offset + (long long)in->pos; }
+static inline long long rt_out_offset(const RtOut* out) { return out->offset + (long long)out->len; }
+
+/* --- Profiling --- */
+typedef struct {
+    int nstmts;
+    long long* count;       // executions per statement
+    long long* iters;       // iterations per FAÇA loop
+    long long* br_count;    // per SE, [2*stmt + branch]
+    long long* br_ns;       // per SE, [2*stmt + branch], time spent inside the branch
+    long long* br_start;    // per SE, clock reading when its current branch was entered
+    int* br_which;          // per SE, branch currently being timed
+} Profile;
+
+Profile* profile_new(const Program* p);
+void profile_free(Profile* prof);
+void profile_listing(const Program* p, const Profile* prof, FILE* out);
+void profile_folded(const Program* p, const Profile* prof, FILE* out);
+
+/* --- Compiler --- */
+#define COMPILE_PROFILE  1  // the bytecode carries OP_PROF_* instructions
+#define COMPILE_OPTIMIZE 2  // run the optimizer on the AST before code generation
+
+// Without COMPILE_PROFILE the generated code is exactly the uninstrumented program
+int compile_program(FILE* tokens, Program* p, int flags);  // 1 on success, diagnostics on stderr
+void free_program(Program* p);
+void free_ast(Node* n);
+void dump_code(const Program* p, FILE* out);
+void print_expr(const Program* p, const Node* n, FILE* out);
+void print_stmt_head(const Program* p, const Node* n, FILE* out);
+
+/* --- Optimizer --- */
+// Rewrites p->ast in place; temporaries for hoisted values get new
+// variable slots and statement ids past the ones from the source
+void optimize_program(Program* p, OptStats* stats);
+void print_opt_stats(const OptStats* s, FILE* out);
+
+/* --- VM --- */
+typedef enum {
+    VM_DONE,
+    VM_ERROR,
+    VM_YIELD,       // instruction budget used up, call vm_run again to continue
+    VM_BLOCKED      // LEIA is waiting for non-blocking input, retry when readable
+} VmStatus;
+
+typedef struct {
+    const Program* prog;
+    Value* vars;
+    Value* stack;
+    int sp;
+    int pc;
+    RtIn* in;
+    RtOut* out;
+    Profile* prof;          // required when the program was compiled for profiling
+    long long steps;        // instructions executed
+} VM;
+
+int vm_init(VM* vm, const Program* p, RtIn* in, RtOut* out);
+void vm_free(VM* vm);
+// Runs until the program ends, or, with budget > 0, until about `budget`
+// instructions have executed (checked on loop back-edges)
+VmStatus vm_run(VM* vm, long long budget);
+
+/* --- Batch (SIMD lanes) --- */
+// Runs one instance per input line, several at a time in vector lanes,
+// and writes one output line per instance. Returns 1 if any instance failed.
+int batch_run(const Program* p, int in_fd, RtOut* out);
+
+/* --- Checkpoints --- */
+typedef struct Checkpointer Checkpointer;
+
+uint64_t program_hash(const Program* p);
+// Starts the background writer for snapshots of a VM running `p`
+Checkpointer* ckpt_start(const char* path, const Program* p, int out_fd);
+// Flushes the VM's output and queues a snapshot of it; returns immediately
+void ckpt_save(Checkpointer* c, VM* vm);
+long long ckpt_stop(Checkpointer* c);
+// Restores frame, pc and stack into an initialized VM and returns where
+// input and output stood. Refuses snapshots of any other program.
+int ckpt_load(const char* path, VM* vm, int binary, long long* in_off, long long* out_off);
+
+#endif
@@ -1,15 +1,19 @@
 // lexer.c
 // Simple DFA-based lexer for X25a with proper UTF-8 support
 // Usage: ./lexer input.x25a > tokens.txt
+// Build with -DX25A_NO_MAIN to embed lex_stream() in another program
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
-// Global error/warning counters
-int error_count = 0;
-int warning_count = 0;
+// Error/warning counters and output streams, per thread so that
+// lex_stream() can run concurrently when embedded
+static _Thread_local int error_count = 0;
+static _Thread_local int warning_count = 0;
+static _Thread_local FILE* outfile;
+static _Thread_local FILE* errfile;
 
 typedef enum {
     T_EOF,
@@ -87,18 +91,18 @@ int utf8_next(FILE* f, unsigned char* buf, int* len, unsigned int* codepoint) {
 
 /* --- Utility functions --- */
 void emit(TokenType t, const char* lexeme) {
-    if(lexeme) printf("%s\t%s\n", token_name(t), lexeme);
-    else printf("%s\n", token_name(t));
+    if(lexeme) fprintf(outfile, "%s\t%s\n", token_name(t), lexeme);
+    else fprintf(outfile, "%s\n", token_name(t));
 }
 
 void lexer_warning(const char* msg) {
     warning_count++;
-    fprintf(stderr, "WARNING: %s\n", msg);
+    fprintf(errfile, "WARNING: %s\n", msg);
 }
 
 void lexer_error(const char* msg) {
     error_count++;
-    fprintf(stderr, "ERROR: %s\n", msg);
+    fprintf(errfile, "ERROR: %s\n", msg);
 }
 
 int iequals(const char* a, const char* b){
@@ -138,10 +142,13 @@ TokenType keyword_or_id(const char* s) {
 }
 
 /* --- Lexer main loop --- */
-int main(int argc, char** argv){
-    if(argc < 2){ fprintf(stderr,"Usage: %s file\n", argv[0]); return 1; }
-    FILE* f = fopen(argv[1],"r");
-    if(!f){ perror("fopen"); return 1; }
+// Writes the token stream of `f` to `out` and diagnostics to `diag`.
+// Returns the number of lexical errors.
+int lex_stream(FILE* f, FILE* out, FILE* diag){
+    outfile = out;
+    errfile = diag;
+    error_count = 0;
+    warning_count = 0;
 
     unsigned char utf8buf[5];
     unsigned int cp;
@@ -235,7 +242,7 @@ int main(int argc, char** argv){
             TokenType t = keyword_or_id(lexeme);
             if(t==T_ERROR){
                 lexer_error("Invalid identifier (must be 1-3 lowercase letters)");
-                fprintf(stderr, "  Found: '%s'\n", lexeme);
+                fprintf(errfile, "  Found: '%s'\n", lexeme);
                 emit(T_ERROR,lexeme);
                 continue; // Continue lexing after invalid identifier
             }
@@ -273,24 +280,35 @@ int main(int argc, char** argv){
                 char msg[128];
                 snprintf(msg, sizeof(msg), "Unexpected character (U+%04X) - skipping", cp);
                 lexer_warning(msg);
-                fprintf(stderr, "  Character: ");
+                fprintf(errfile, "  Character: ");
                 for(int i = 0; i < len; i++) {
-                    fprintf(stderr, "\\x%02X", utf8buf[i]);
+                    fprintf(errfile, "\\x%02X", utf8buf[i]);
                 }
-                fprintf(stderr, "\n");
+                fprintf(errfile, "\n");
                 // Don't emit token, just skip and continue
                 continue;
         }
     }
 
-    fclose(f);
-    
     // Print summary
     if(error_count > 0 || warning_count > 0) {
-        fprintf(stderr, "\n=== Lexical Analysis Summary ===\n");
-        fprintf(stderr, "Errors:   %d\n", error_count);
-        fprintf(stderr, "Warnings: %d\n", warning_count);
+        fprintf(errfile, "\n=== Lexical Analysis Summary ===\n");
+        fprintf(errfile, "Errors:   %d\n", error_count);
+        fprintf(errfile, "Warnings: %d\n", warning_count);
     }
-    
-    return (error_count > 0) ? 1 : 0;
+
+    return error_count;
+}
+
+#ifndef X25A_NO_MAIN
+int main(int argc, char** argv){
+    if(argc < 2){ fprintf(stderr,"Usage: %s file\n", argv[0]); return 1; }
+    FILE* f = fopen(argv[1],"r");
+    if(!f){ perror("fopen"); return 1; }
+
+    int errors = lex_stream(f, stdout, stderr);
+    fclose(f);
+
+    return (errors > 0) ? 1 : 0;
 }
+#endif
@@ -0,0 +1,595 @@
+// optimize.c
+// AST-level optimizer, run between parsing and code generation so every
+// backend (bytecode VM, scheduler, SIMD batch) executes the result.
+//
+// SE and FAÇA are the only control flow, so the control-flow graph is the
+// shape of the AST itself: the dataflow passes walk it directly and iterate
+// every FAÇA body to a fixpoint over its back edge.
+//
+//   - constant propagation and folding (forward; variables start at 0)
+//   - algebraic simplification (x + 0, x * 1, (x + 1) + 2, ...)
+//   - SE branches and FAÇA loops decided by a constant condition
+//   - dead and redundant stores (backward liveness)
+//   - loop-invariant code motion out of FAÇA bodies
+//
+// A division whose divisor is not a known nonzero constant may trap, so it
+// is never folded, removed or moved: division by zero stays a runtime error
+// at the same point in the program.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "interp.h"
+
+#define MAX_ROUNDS 8
+
+typedef enum { L_NONE, L_CONST, L_ANY } LatKind;   // no value reaches / one constant / unknown
+
+typedef struct {
+    LatKind k;
+    Value c;
+} Lat;
+
+typedef struct {
+    Program* prog;
+    OptStats* st;
+    int changes;
+} Opt;
+
+static void* xcalloc(size_t n, size_t size) {
+    void* p = calloc(n ? n : 1, size);
+    if(!p){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+    return p;
+}
+
+static Node* new_node(NodeKind kind, const Node* at) {
+    Node* n = xcalloc(1, sizeof(Node));
+    n->kind = kind;
+    n->tokpos = at->tokpos;
+    return n;
+}
+
+// Frees one statement (or expression) without the rest of its sequence
+static void free_one(Node* n) {
+    n->next = NULL;
+    free_ast(n);
+}
+
+// Same results as the VM; 0 for a division by zero, which must trap at run time
+static int fold_op(NodeKind k, Value a, Value b, Value* r) {
+    switch(k){
+        case N_ADD: *r = (Value)((uint64_t)a + (uint64_t)b); return 1;
+        case N_SUB: *r = (Value)((uint64_t)a - (uint64_t)b); return 1;
+        case N_MUL: *r = (Value)((uint64_t)a * (uint64_t)b); return 1;
+        case N_DIV:
+            if(b == 0) return 0;
+            *r = (b == -1) ? (Value)(0 - (uint64_t)a) : a / b;
+            return 1;
+        case N_LT: *r = a < b; return 1;
+        case N_EQ: *r = a == b; return 1;
+        default: return 0;
+    }
+}
+
+static int is_leaf(const Node* e) {
+    return e->kind == N_NUM || e->kind == N_VAR;
+}
+
+static int is_num(const Node* e, Value v) {
+    return e->kind == N_NUM && e->num == v;
+}
+
+static int may_trap(const Node* e) {
+    if(is_leaf(e)) return 0;
+    if(e->kind == N_DIV && !(e->b->kind == N_NUM && e->b->num != 0)) return 1;
+    return may_trap(e->a) || may_trap(e->b);
+}
+
+static int same_expr(const Node* x, const Node* y) {
+    if(x->kind != y->kind) return 0;
+    switch(x->kind){
+        case N_NUM: return x->num == y->num;
+        case N_VAR: return x->var == y->var;
+        default: return same_expr(x->a, y->a) && same_expr(x->b, y->b);
+    }
+}
+
+static void mark_uses(const Node* e, char* used) {
+    if(e->kind == N_VAR) used[e->var] = 1;
+    else if(!is_leaf(e)){
+        mark_uses(e->a, used);
+        mark_uses(e->b, used);
+    }
+}
+
+// Replaces the operator at *e by its operand `keep`
+static void keep_operand(Node** e, Node* keep) {
+    Node* n = *e;
+    if(n->a == keep) n->a = NULL;
+    else n->b = NULL;
+    *e = keep;
+    free_one(n);
+}
+
+static void make_num(Node* n, Value v) {
+    if(n->a) free_one(n->a);
+    if(n->b) free_one(n->b);
+    n->a = n->b = NULL;
+    n->kind = N_NUM;
+    n->num = v;
+}
+
+/* --- Constant propagation, folding and simplification --- */
+static Lat lat_eval(const Node* e, const Lat* vars) {
+    if(e->kind == N_NUM) return (Lat){ L_CONST, e->num };
+    if(e->kind == N_VAR) return vars[e->var];
+    Lat a = lat_eval(e->a, vars), b = lat_eval(e->b, vars);
+    if(a.k == L_NONE || b.k == L_NONE) return (Lat){ L_NONE, 0 };
+    Value r;
+    if(a.k == L_CONST && b.k == L_CONST && fold_op(e->kind, a.c, b.c, &r)) return (Lat){ L_CONST, r };
+    return (Lat){ L_ANY, 0 };
+}
+
+// Merges the state of another path into dst; returns whether dst changed
+static int lat_join(Lat* dst, const Lat* src, int n) {
+    int changed = 0;
+    for(int i = 0; i < n; i++){
+        if(src[i].k == L_NONE || dst[i].k == L_ANY) continue;
+        if(dst[i].k == L_NONE) dst[i] = src[i];
+        else if(src[i].k == L_ANY || src[i].c != dst[i].c) dst[i] = (Lat){ L_ANY, 0 };
+        else continue;
+        changed = 1;
+    }
+    return changed;
+}
+
+static void simplify(Opt* o, Node** e) {
+    Node* n = *e;
+    Node *a = n->a, *b = n->b;
+    switch(n->kind){
+        case N_ADD:
+            if(is_num(b, 0)){ keep_operand(e, a); break; }
+            if(is_num(a, 0)){ keep_operand(e, b); break; }
+            // fall through
+        case N_SUB:
+            if(n->kind == N_SUB && is_num(b, 0)){ keep_operand(e, a); break; }
+            // (x ± c1) ± c2  ->  x + (±c1 ± c2)
+            if(b->kind == N_NUM && (a->kind == N_ADD || a->kind == N_SUB) && a->b->kind == N_NUM){
+                uint64_t c1 = a->b->num, c2 = b->num;
+                uint64_t k = (a->kind == N_ADD ? c1 : 0 - c1) + (n->kind == N_ADD ? c2 : 0 - c2);
+                n->kind = N_ADD;
+                b->num = (Value)k;
+                n->a = a->a;
+                a->a = NULL;
+                free_one(a);
+                o->st->simplified++;
+                o->changes++;
+                simplify(o, e);
+                return;
+            }
+            if(n->kind == N_SUB && same_expr(a, b) && !may_trap(a)){ make_num(n, 0); break; }
+            return;
+        case N_MUL:
+            if(is_num(b, 1)){ keep_operand(e, a); break; }
+            if(is_num(a, 1)){ keep_operand(e, b); break; }
+            if((is_num(b, 0) && !may_trap(a)) || (is_num(a, 0) && !may_trap(b))){ make_num(n, 0); break; }
+            return;
+        case N_DIV:
+            if(is_num(b, 1)){ keep_operand(e, a); break; }
+            return;
+        case N_LT:
+        case N_EQ:
+            if(same_expr(a, b) && !may_trap(a)){ make_num(n, n->kind == N_EQ); break; }
+            return;
+        default:
+            return;
+    }
+    o->st->simplified++;
+    o->changes++;
+}
+
+static void rewrite_expr(Opt* o, Node** e, const Lat* vars) {
+    Node* n = *e;
+    if(n->kind == N_NUM) return;
+    if(n->kind == N_VAR){
+        if(vars[n->var].k == L_CONST){
+            n->kind = N_NUM;
+            n->num = vars[n->var].c;
+            o->st->propagated++;
+            o->changes++;
+        }
+        return;
+    }
+    rewrite_expr(o, &n->a, vars);
+    rewrite_expr(o, &n->b, vars);
+    Value r;
+    if(n->a->kind == N_NUM && n->b->kind == N_NUM && fold_op(n->kind, n->a->num, n->b->num, &r)){
+        make_num(n, r);
+        o->st->folded++;
+        o->changes++;
+        return;
+    }
+    simplify(o, e);
+}
+
+// Drops the statement at *link, putting `keep` (a statement list, may be
+// NULL) in its place. Returns the link after the last kept statement.
+static Node** replace_stmt(Node** link, Node* keep) {
+    Node* n = *link;
+    Node* next = n->next;
+    *link = keep ? keep : next;
+    while(*link != next){
+        link = &(*link)->next;
+        if(!*link) *link = next;
+    }
+    free_one(n);
+    return link;
+}
+
+// Walks the statements at *link updating `vars` from entry to exit state.
+// With `rewrite` set the code is changed to use what the analysis proved.
+static void cp_stmts(Opt* o, Node** link, Lat* vars, int rewrite) {
+    int nv = o->prog->nvars;
+    while(*link){
+        Node* n = *link;
+        switch(n->kind){
+            case N_ASSIGN: {
+                Lat v = lat_eval(n->a, vars);
+                if(rewrite){
+                    rewrite_expr(o, &n->a, vars);
+                    // the variable already holds this value on every path
+                    if(v.k == L_CONST && vars[n->var].k == L_CONST && vars[n->var].c == v.c && !may_trap(n->a)){
+                        replace_stmt(link, NULL);
+                        o->st->dead_stores++;
+                        o->changes++;
+                        continue;
+                    }
+                }
+                vars[n->var] = v;
+                break;
+            }
+            case N_READ:
+                vars[n->var] = (Lat){ L_ANY, 0 };
+                break;
+            case N_IF: {
+                Lat c = lat_eval(n->a, vars);
+                if(c.k == L_CONST){
+                    if(rewrite){
+                        Node* keep = c.c ? n->body : n->alt;
+                        if(c.c) n->body = NULL;
+                        else n->alt = NULL;
+                        replace_stmt(link, keep);
+                        o->st->dead_branches++;
+                        o->changes++;
+                        continue;   // the kept branch is processed in place
+                    }
+                    cp_stmts(o, c.c ? &n->body : &n->alt, vars, 0);
+                    break;
+                }
+                if(rewrite) rewrite_expr(o, &n->a, vars);
+                Lat* other = xcalloc(nv, sizeof(Lat));
+                memcpy(other, vars, sizeof(Lat) * nv);
+                cp_stmts(o, &n->body, vars, rewrite);
+                cp_stmts(o, &n->alt, other, rewrite);
+                lat_join(vars, other, nv);
+                free(other);
+                break;
+            }
+            case N_DO_WHILE: {
+                // the state at the top of the body is the entry state joined
+                // with the back edge; it only grows, so this terminates
+                Lat* in = xcalloc(nv, sizeof(Lat));
+                memcpy(in, vars, sizeof(Lat) * nv);
+                Lat c;
+                for(;;){
+                    memcpy(vars, in, sizeof(Lat) * nv);
+                    cp_stmts(o, &n->body, vars, 0);
+                    c = lat_eval(n->a, vars);
+                    if(c.k == L_CONST && c.c == 0) break;   // no back edge
+                    if(!lat_join(in, vars, nv)) break;
+                }
+                if(rewrite){
+                    memcpy(vars, in, sizeof(Lat) * nv);
+                    cp_stmts(o, &n->body, vars, 1);
+                    rewrite_expr(o, &n->a, vars);
+                }
+                free(in);
+                if(c.k == L_CONST && c.c == 0 && rewrite){
+                    // the body runs exactly once and replaces the loop
+                    Node* body = n->body;
+                    n->body = NULL;
+                    link = replace_stmt(link, body);
+                    o->st->dead_branches++;
+                    o->changes++;
+                    continue;
+                }
+                if(c.k == L_CONST && c.c != 0){
+                    // never exits: nothing after it is reachable
+                    for(int i = 0; i < nv; i++) vars[i] = (Lat){ L_NONE, 0 };
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        link = &n->next;
+    }
+}
+
+/* --- Dead-store elimination --- */
+// Walks the statements at *link backwards turning `live` (variables read
+// later) from the exit into the entry set. With `rewrite` set, assignments
+// to dead variables and SE statements left without branches are removed.
+static void dse_stmts(Opt* o, Node** link, char* live, int rewrite) {
+    int nv = o->prog->nvars;
+    int cnt = 0;
+    for(Node* n = *link; n; n = n->next) cnt++;
+    if(cnt == 0) return;
+    Node** v = xcalloc(cnt, sizeof(Node*));
+    cnt = 0;
+    for(Node* n = *link; n; n = n->next) v[cnt++] = n;
+
+    for(int i = cnt - 1; i >= 0; i--){
+        Node* n = v[i];
+        switch(n->kind){
+            case N_ASSIGN:
+                if(rewrite && !live[n->var] && !may_trap(n->a)){
+                    free_one(n);
+                    v[i] = NULL;
+                    o->st->dead_stores++;
+                    o->changes++;
+                    break;
+                }
+                live[n->var] = 0;
+                mark_uses(n->a, live);
+                break;
+            case N_READ:
+                live[n->var] = 0;   // still consumes input, never removed
+                break;
+            case N_WRITE_VAR:
+                live[n->var] = 1;
+                break;
+            case N_IF: {
+                char* other = xcalloc(nv, 1);
+                memcpy(other, live, nv);
+                dse_stmts(o, &n->body, live, rewrite);
+                dse_stmts(o, &n->alt, other, rewrite);
+                for(int k = 0; k < nv; k++) live[k] |= other[k];
+                free(other);
+                if(rewrite && !n->body && !n->alt && !may_trap(n->a)){
+                    free_one(n);
+                    v[i] = NULL;
+                    o->st->dead_branches++;
+                    o->changes++;
+                    break;
+                }
+                mark_uses(n->a, live);
+                break;
+            }
+            case N_DO_WHILE: {
+                // live at the end of the body: after the loop, the condition
+                // and the top of the next iteration
+                char* out = xcalloc(nv, 1);
+                char* end = xcalloc(nv, 1);
+                memcpy(out, live, nv);
+                mark_uses(n->a, out);
+                memcpy(end, out, nv);
+                for(;;){
+                    memcpy(live, end, nv);
+                    dse_stmts(o, &n->body, live, 0);
+                    int changed = 0;
+                    for(int k = 0; k < nv; k++){
+                        if(live[k] && !end[k]){
+                            end[k] = 1;
+                            changed = 1;
+                        }
+                    }
+                    if(!changed) break;
+                }
+                if(rewrite){
+                    memcpy(live, end, nv);
+                    dse_stmts(o, &n->body, live, 1);
+                }
+                free(out);
+                free(end);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    Node** tail = link;
+    for(int i = 0; i < cnt; i++){
+        if(!v[i]) continue;
+        *tail = v[i];
+        tail = &v[i]->next;
+    }
+    *tail = NULL;
+    free(v);
+}
+
+/* --- Loop-invariant code motion --- */
+// A FAÇA body always runs at least once, so an expression that reads no
+// variable written in the loop and cannot trap gives the same value when
+// computed once before it.
+typedef struct {
+    int* defs;          // per variable, assignments and LEIAs inside the loop
+    Node* head;         // statements to put before the loop
+    Node** tail;
+    Node** exprs;       // expressions already hoisted, and their temporaries
+    int* temps;
+    int nexprs;
+    const Node* loop;
+} Hoist;
+
+static void count_defs(const Node* n, int* defs) {
+    for(; n; n = n->next){
+        if(n->kind == N_ASSIGN || n->kind == N_READ) defs[n->var]++;
+        count_defs(n->body, defs);
+        count_defs(n->alt, defs);
+    }
+}
+
+// Variables read by statement `n`, including everything nested in it
+static void mark_stmt_uses(const Node* n, char* used) {
+    if(n->kind == N_WRITE_VAR) used[n->var] = 1;
+    if(n->a) mark_uses(n->a, used);
+    for(const Node* s = n->body; s; s = s->next) mark_stmt_uses(s, used);
+    for(const Node* s = n->alt; s; s = s->next) mark_stmt_uses(s, used);
+}
+
+static int invariant(const Node* e, const int* defs) {
+    if(e->kind == N_NUM) return 1;
+    if(e->kind == N_VAR) return defs[e->var] == 0;
+    return invariant(e->a, defs) && invariant(e->b, defs);
+}
+
+static void hoist_append(Hoist* h, Node* n) {
+    n->next = NULL;
+    *h->tail = n;
+    h->tail = &n->next;
+}
+
+// New variable for a hoisted value; '$' cannot start an X25a identifier
+static int new_temp(Program* p) {
+    char name[24];
+    snprintf(name, sizeof(name), "$%d", p->nvars);
+    char** vars = realloc(p->vars, sizeof(char*) * (p->nvars + 1));
+    if(!vars){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+    p->vars = vars;
+    p->vars[p->nvars] = strdup(name);
+    return p->nvars++;
+}
+
+static void hoist_expr(Opt* o, Hoist* h, Node** e) {
+    Node* n = *e;
+    if(is_leaf(n)) return;
+    if(!invariant(n, h->defs) || may_trap(n)){
+        hoist_expr(o, h, &n->a);
+        hoist_expr(o, h, &n->b);
+        return;
+    }
+    Node* v = new_node(N_VAR, n);
+    int var = -1;
+    for(int i = 0; i < h->nexprs && var < 0; i++)
+        if(same_expr(h->exprs[i], n)) var = h->temps[i];
+    if(var >= 0){
+        free_one(n);
+    } else {
+        var = new_temp(o->prog);
+        Node* s = new_node(N_ASSIGN, h->loop);
+        s->id = o->prog->nstmts++;
+        s->var = var;
+        s->a = n;
+        hoist_append(h, s);
+        h->exprs = realloc(h->exprs, sizeof(Node*) * (h->nexprs + 1));
+        h->temps = realloc(h->temps, sizeof(int) * (h->nexprs + 1));
+        if(!h->exprs || !h->temps){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+        h->exprs[h->nexprs] = n;
+        h->temps[h->nexprs++] = var;
+        o->st->hoisted++;
+        o->changes++;
+    }
+    v->var = var;
+    *e = v;
+}
+
+static void hoist_stmt_exprs(Opt* o, Hoist* h, Node* n) {
+    for(; n; n = n->next){
+        if(n->a) hoist_expr(o, h, &n->a);
+        hoist_stmt_exprs(o, h, n->body);
+        hoist_stmt_exprs(o, h, n->alt);
+    }
+}
+
+// Returns the statements to insert before `loop` (NULL if none)
+static Node* hoist_loop(Opt* o, Node* loop) {
+    int nv = o->prog->nvars;
+    Hoist h = { .defs = xcalloc(nv, sizeof(int)), .loop = loop };
+    h.tail = &h.head;
+    char* used = xcalloc(nv, 1);
+    count_defs(loop->body, h.defs);
+
+    // whole assignments: the only write to their variable, which the loop
+    // does not read before it
+    Node** link = &loop->body;
+    while(*link){
+        Node* n = *link;
+        if(n->kind == N_ASSIGN && h.defs[n->var] == 1 && !used[n->var] &&
+           invariant(n->a, h.defs) && !may_trap(n->a)){
+            *link = n->next;
+            h.defs[n->var] = 0;
+            hoist_append(&h, n);
+            o->st->hoisted++;
+            o->changes++;
+            continue;
+        }
+        mark_stmt_uses(n, used);
+        link = &n->next;
+    }
+
+    // invariant parts of the remaining expressions go to temporaries
+    hoist_stmt_exprs(o, &h, loop->body);
+    hoist_expr(o, &h, &loop->a);
+
+    free(h.defs);
+    free(h.exprs);
+    free(h.temps);
+    free(used);
+    return h.head;
+}
+
+static void licm_stmts(Opt* o, Node** link) {
+    for(; *link; link = &(*link)->next){
+        Node* n = *link;
+        if(n->kind == N_IF){
+            licm_stmts(o, &n->body);
+            licm_stmts(o, &n->alt);
+        } else if(n->kind == N_DO_WHILE){
+            licm_stmts(o, &n->body);    // inner loops first, so their hoists can move on out
+            Node* pre = hoist_loop(o, n);
+            if(pre){
+                Node* t = pre;
+                while(t->next) t = t->next;
+                t->next = n;
+                *link = pre;
+                link = &t->next;
+            }
+        }
+    }
+}
+
+/* --- Driver --- */
+void optimize_program(Program* p, OptStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    Opt o = { .prog = p, .st = stats };
+    do {
+        o.changes = 0;
+        stats->rounds++;
+
+        // variables start at zero
+        Lat* vars = xcalloc(p->nvars, sizeof(Lat));
+        for(int i = 0; i < p->nvars; i++) vars[i] = (Lat){ L_CONST, 0 };
+        cp_stmts(&o, &p->ast, vars, 1);
+        free(vars);
+
+        licm_stmts(&o, &p->ast);
+
+        char* live = xcalloc(p->nvars, 1);
+        dse_stmts(&o, &p->ast, live, 1);
+        free(live);
+    } while(o.changes && stats->rounds < MAX_ROUNDS);
+}
+
+void print_opt_stats(const OptStats* s, FILE* out) {
+    fprintf(out, "═══════════════════════════════════════════════════════════\n");
+    fprintf(out, "  Optimizer (%d round%s)\n", s->rounds, s->rounds == 1 ? "" : "s");
+    fprintf(out, "═══════════════════════════════════════════════════════════\n");
+    fprintf(out, "%-36s %8d  variable reads\n", "constant propagation", s->propagated);
+    fprintf(out, "%-36s %8d  operations\n", "constant folding", s->folded);
+    fprintf(out, "%-36s %8d  rewrites\n", "algebraic simplification", s->simplified);
+    fprintf(out, "%-36s %8d  branches / loops\n", "unreachable code elimination", s->dead_branches);
+    fprintf(out, "%-36s %8d  assignments\n", "dead-store elimination", s->dead_stores);
+    fprintf(out, "%-36s %8d  statements / expressions\n", "loop-invariant code motion", s->hoisted);
+}
@@ -1,6 +1,7 @@
 // parser.c
 // LL(1) Recursive-descent parser for X25a with comprehensive error recovery
 // Usage: ./parser tokens.txt
+// Build with -DX25A_NO_MAIN to embed parse_stream() in another program
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,11 +22,14 @@ typedef struct {
     int line_number;  // Track position for better error messages
 } Token;
 
-FILE* infile;
-Token curtok;
-int error_count = 0;
-int warning_count = 0;
-int token_count = 0;  // Track tokens processed
+// Parser state is per thread so that parse_stream() can run concurrently
+static _Thread_local FILE* infile;
+static _Thread_local FILE* outfile;
+static _Thread_local FILE* errfile;
+static _Thread_local Token curtok;
+static _Thread_local int error_count = 0;
+static _Thread_local int warning_count = 0;
+static _Thread_local int token_count = 0;  // Track tokens processed
 
 // LL(1) FIRST and FOLLOW sets for intelligent recovery
 typedef enum {
@@ -129,16 +133,16 @@ const char* token_type_name(TokenType t) {
 
 void syntax_error(const char* msg){
     error_count++;
-    fprintf(stderr, "\n╔════════════════════════════════════════════════════════════╗\n");
-    fprintf(stderr, "║ SYNTAX ERROR #%d (Token Position: %d)\n", error_count, curtok.line_number);
-    fprintf(stderr, "╠════════════════════════════════════════════════════════════╣\n");
-    fprintf(stderr, "║ %s\n", msg);
-    fprintf(stderr, "║ Found: %s", token_type_name(curtok.type));
+    fprintf(errfile, "\n╔════════════════════════════════════════════════════════════╗\n");
+    fprintf(errfile, "║ SYNTAX ERROR #%d (Token Position: %d)\n", error_count, curtok.line_number);
+    fprintf(errfile, "╠════════════════════════════════════════════════════════════╣\n");
+    fprintf(errfile, "║ %s\n", msg);
+    fprintf(errfile, "║ Found: %s", token_type_name(curtok.type));
     if(strlen(curtok.lexeme) > 0) {
-        fprintf(stderr, " '%s'", curtok.lexeme);
+        fprintf(errfile, " '%s'", curtok.lexeme);
     }
-    fprintf(stderr, "\n");
-    fprintf(stderr, "╚════════════════════════════════════════════════════════════╝\n");
+    fprintf(errfile, "\n");
+    fprintf(errfile, "╚════════════════════════════════════════════════════════════╝\n");
 }
 
 // Check if current token is in the synchronization set
@@ -161,37 +165,37 @@ int in_sync_set(SyncSet sync) {
 
 // LL(1) panic mode recovery with synchronization set
 void panic_mode_recovery(SyncSet sync) {
-    fprintf(stderr, "  → Recovery Strategy: Skipping tokens until synchronization point\n");
-    fprintf(stderr, "  → Looking for: ");
+    fprintf(errfile, "  → Recovery Strategy: Skipping tokens until synchronization point\n");
+    fprintf(errfile, "  → Looking for: ");
 
     int first = 1;
-    if(sync & SYNC_COMMA) { fprintf(stderr, "%sCOMMA", first ? "" : ", "); first = 0; }
-    if(sync & SYNC_FIM) { fprintf(stderr, "%sFIM", first ? "" : ", "); first = 0; }
-    if(sync & SYNC_SENAO) { fprintf(stderr, "%sSENÃO", first ? "" : ", "); first = 0; }
-    if(sync & SYNC_ENQUANTO) { fprintf(stderr, "%sENQUANTO", first ? "" : ", "); first = 0; }
-    if(sync & SYNC_RPAREN) { fprintf(stderr, "%s)", first ? "" : ", "); first = 0; }
-    if(sync & SYNC_DECL_START) { fprintf(stderr, "%sdeclaration start", first ? "" : ", "); first = 0; }
-    if(sync & SYNC_EOF) { fprintf(stderr, "%sEOF", first ? "" : ", "); first = 0; }
-    fprintf(stderr, "\n\n");
+    if(sync & SYNC_COMMA) { fprintf(errfile, "%sCOMMA", first ? "" : ", "); first = 0; }
+    if(sync & SYNC_FIM) { fprintf(errfile, "%sFIM", first ? "" : ", "); first = 0; }
+    if(sync & SYNC_SENAO) { fprintf(errfile, "%sSENÃO", first ? "" : ", "); first = 0; }
+    if(sync & SYNC_ENQUANTO) { fprintf(errfile, "%sENQUANTO", first ? "" : ", "); first = 0; }
+    if(sync & SYNC_RPAREN) { fprintf(errfile, "%s)", first ? "" : ", "); first = 0; }
+    if(sync & SYNC_DECL_START) { fprintf(errfile, "%sdeclaration start", first ? "" : ", "); first = 0; }
+    if(sync & SYNC_EOF) { fprintf(errfile, "%sEOF", first ? "" : ", "); first = 0; }
+    fprintf(errfile, "\n\n");
 
     int max_skip = 50;  // Prevent infinite loops
     int skipped = 0;
 
     while(!in_sync_set(sync) && curtok.type != T_EOF && skipped < max_skip) {
-        fprintf(stderr, "  ... skipping %s", token_type_name(curtok.type));
+        fprintf(errfile, "  ... skipping %s", token_type_name(curtok.type));
         if(strlen(curtok.lexeme) > 0) {
-            fprintf(stderr, " '%s'", curtok.lexeme);
+            fprintf(errfile, " '%s'", curtok.lexeme);
         }
-        fprintf(stderr, "\n");
+        fprintf(errfile, "\n");
 
         if(!read_token()) break;
         skipped++;
     }
 
     if(skipped >= max_skip) {
-        fprintf(stderr, "  ✗ Recovery failed: too many tokens skipped\n\n");
+        fprintf(errfile, "  ✗ Recovery failed: too many tokens skipped\n\n");
     } else if(curtok.type != T_EOF) {
-        fprintf(stderr, "  ✓ Recovery successful: found %s\n\n", token_type_name(curtok.type));
+        fprintf(errfile, "  ✓ Recovery successful: found %s\n\n", token_type_name(curtok.type));
     }
 }
 
@@ -209,13 +213,13 @@ void expect(TokenType t, const char* context){
 
         // Provide helpful recovery hints
         if(t == T_ASSIGN && curtok.type == T_EQ) {
-            fprintf(stderr, "  Hint: Use ':=' for assignment, not '='\n");
+            fprintf(errfile, "  Hint: Use ':=' for assignment, not '='\n");
         } else if(t == T_KW_ENTAO && curtok.type == T_KW_FIM) {
-            fprintf(stderr, "  Hint: SE requires ENTÃO before the body\n");
+            fprintf(errfile, "  Hint: SE requires ENTÃO before the body\n");
         } else if(t == T_KW_FIM && curtok.type == T_KW_ENQUANTO) {
-            fprintf(stderr, "  Hint: This might be a FAÇA...ENQUANTO loop (no FIM needed)\n");
+            fprintf(errfile, "  Hint: This might be a FAÇA...ENQUANTO loop (no FIM needed)\n");
         } else if(t == T_KW_ENQUANTO && curtok.type == T_KW_FIM) {
-            fprintf(stderr, "  Hint: FAÇA loops end with ENQUANTO condition, not FIM\n");
+            fprintf(errfile, "  Hint: FAÇA loops end with ENQUANTO condition, not FIM\n");
         }
 
         // Don't skip the token if it might be useful for recovery
@@ -256,9 +260,9 @@ int is_decl_start(){
 }
 
 void parse_PROGRAM(){
-    printf("═══════════════════════════════════════════════════════════\n");
-    printf("  Starting LL(1) Syntax Analysis\n");
-    printf("═══════════════════════════════════════════════════════════\n\n");
+    fprintf(outfile, "═══════════════════════════════════════════════════════════\n");
+    fprintf(outfile, "  Starting LL(1) Syntax Analysis\n");
+    fprintf(outfile, "═══════════════════════════════════════════════════════════\n\n");
 
     parse_DECL_LIST(SYNC_EOF);
 
@@ -267,27 +271,27 @@ void parse_PROGRAM(){
         syntax_error("Unexpected token after end of program");
 
         if(curtok.type == T_KW_FIM) {
-            fprintf(stderr, "  Hint: Extra FIM - check if SE blocks are balanced\n");
+            fprintf(errfile, "  Hint: Extra FIM - check if SE blocks are balanced\n");
         } else if(curtok.type == T_KW_SENAO) {
-            fprintf(stderr, "  Hint: SENÃO without matching SE...ENTÃO\n");
+            fprintf(errfile, "  Hint: SENÃO without matching SE...ENTÃO\n");
         } else if(curtok.type == T_KW_ENQUANTO) {
-            fprintf(stderr, "  Hint: ENQUANTO without matching FAÇA\n");
+            fprintf(errfile, "  Hint: ENQUANTO without matching FAÇA\n");
         }
 
         if(!read_token()) break;
     }
 
     // Final summary
-    printf("\n═══════════════════════════════════════════════════════════\n");
-    printf("  Analysis Complete\n");
-    printf("═══════════════════════════════════════════════════════════\n");
+    fprintf(outfile, "\n═══════════════════════════════════════════════════════════\n");
+    fprintf(outfile, "  Analysis Complete\n");
+    fprintf(outfile, "═══════════════════════════════════════════════════════════\n");
 
     if(error_count == 0) {
-        printf("\n✓ SUCCESS: Program is syntactically correct!\n");
-        printf("  All %d tokens parsed successfully.\n", token_count);
+        fprintf(outfile, "\n✓ SUCCESS: Program is syntactically correct!\n");
+        fprintf(outfile, "  All %d tokens parsed successfully.\n", token_count);
     } else {
-        printf("\n✗ FAILED: Found %d error(s)\n", error_count);
-        printf("  Please fix the errors and try again.\n");
+        fprintf(outfile, "\n✗ FAILED: Found %d error(s)\n", error_count);
+        fprintf(outfile, "  Please fix the errors and try again.\n");
     }
 }
 
@@ -336,7 +340,7 @@ void parse_REST_DECLS(SyncSet follow) {
     // Handle double comma case
     else if (curtok.type == T_COMMA) {
         syntax_error("Double comma found");
-        fprintf(stderr, "  Hint: Remove the extra comma\n");
+        fprintf(errfile, "  Hint: Remove the extra comma\n");
         read_token(); // Skip the extra comma
         parse_REST_DECLS(follow);
     }
@@ -418,7 +422,7 @@ void parse_DO_WHILE_ST(SyncSet follow){
     // Handle extra FIM tokens before ENQUANTO
     while(curtok.type == T_KW_FIM) {
         syntax_error("Extra FIM in FAÇA loop - skipping");
-        fprintf(stderr, "  Hint: FAÇA loops should not have FIM before ENQUANTO\n");
+        fprintf(errfile, "  Hint: FAÇA loops should not have FIM before ENQUANTO\n");
         read_token(); // Skip the extra FIM
     }
     
@@ -435,7 +439,7 @@ void parse_REL_EXPR(SyncSet follow){
         expect(op, "relational expression");
     } else {
         syntax_error("Expected relational operator ('<' or '=')");
-        fprintf(stderr, "  Hint: X25a only supports '<' (less than) and '=' (equals)\n");
+        fprintf(errfile, "  Hint: X25a only supports '<' (less than) and '=' (equals)\n");
         panic_mode_recovery(follow);
         return;
     }
@@ -495,11 +499,41 @@ void parse_FACTOR(SyncSet follow){
         expect(T_RPAREN, "parenthesized expression");
     } else {
         syntax_error("Expected expression factor (number, identifier, or '(')");
-        fprintf(stderr, "  Hint: Valid factors are numbers, variables, or (expression)\n");
+        fprintf(errfile, "  Hint: Valid factors are numbers, variables, or (expression)\n");
         panic_mode_recovery(follow);
     }
 }
 
+// Parses the token stream `tokens`, writing the report to `out` and
+// diagnostics to `diag`. Returns the number of syntax errors, or -1 if
+// the token stream is empty.
+int parse_stream(FILE* tokens, FILE* out, FILE* diag){
+    infile = tokens;
+    outfile = out;
+    errfile = diag;
+    error_count = 0;
+    warning_count = 0;
+    token_count = 0;
+
+    if(!read_token()){
+        fprintf(errfile, "Error: Empty token file\n");
+        return -1;
+    }
+
+    parse_PROGRAM();
+
+    fprintf(outfile, "\n═══════════════════════════════════════════════════════════\n");
+    fprintf(outfile, "  Final Statistics\n");
+    fprintf(outfile, "═══════════════════════════════════════════════════════════\n");
+    fprintf(outfile, "  Tokens Processed: %d\n", token_count);
+    fprintf(outfile, "  Errors Found:     %d\n", error_count);
+    fprintf(outfile, "  Warnings Issued:  %d\n", warning_count);
+    fprintf(outfile, "═══════════════════════════════════════════════════════════\n\n");
+
+    return error_count;
+}
+
+#ifndef X25A_NO_MAIN
 int main(int argc, char** argv){
     if(argc < 2){
         fprintf(stderr, "Usage: %s tokens.txt\n", argv[0]);
@@ -507,29 +541,16 @@ int main(int argc, char** argv){
         return 1;
     }
 
-    infile = fopen(argv[1], "r");
-    if(!infile){
+    FILE* f = fopen(argv[1], "r");
+    if(!f){
         fprintf(stderr, "Error: Cannot open '%s'\n", argv[1]);
         perror("fopen");
         return 1;
     }
 
-    if(!read_token()){
-        fprintf(stderr, "Error: Empty token file\n");
-        fclose(infile);
-        return 1;
-    }
-
-    parse_PROGRAM();
-    fclose(infile);
-
-    printf("\n═══════════════════════════════════════════════════════════\n");
-    printf("  Final Statistics\n");
-    printf("═══════════════════════════════════════════════════════════\n");
-    printf("  Tokens Processed: %d\n", token_count);
-    printf("  Errors Found:     %d\n", error_count);
-    printf("  Warnings Issued:  %d\n", warning_count);
-    printf("═══════════════════════════════════════════════════════════\n\n");
+    int errors = parse_stream(f, stdout, stderr);
+    fclose(f);
 
-    return (error_count > 0) ? 1 : 0;
+    return (errors != 0) ? 1 : 0;
 }
+#endif
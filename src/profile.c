@@ -0,0 +1,150 @@
+// profile.c
+// Execution profile of an X25a program: counters filled in by the OP_PROF_*
+// instructions, reported as an annotated listing or as folded stacks
+// (one "frame;frame;... weight" line per statement, for flamegraph.pl)
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "interp.h"
+
+Profile* profile_new(const Program* p) {
+    Profile* prof = calloc(1, sizeof(Profile));
+    if(!prof) return NULL;
+    int n = p->nstmts ? p->nstmts : 1;
+    prof->nstmts = p->nstmts;
+    prof->count = calloc(n, sizeof(long long));
+    prof->iters = calloc(n, sizeof(long long));
+    prof->br_count = calloc(2 * n, sizeof(long long));
+    prof->br_ns = calloc(2 * n, sizeof(long long));
+    prof->br_start = calloc(n, sizeof(long long));
+    prof->br_which = calloc(n, sizeof(int));
+    if(!prof->count || !prof->iters || !prof->br_count || !prof->br_ns ||
+       !prof->br_start || !prof->br_which){
+        profile_free(prof);
+        return NULL;
+    }
+    return prof;
+}
+
+void profile_free(Profile* prof) {
+    if(!prof) return;
+    free(prof->count);
+    free(prof->iters);
+    free(prof->br_count);
+    free(prof->br_ns);
+    free(prof->br_start);
+    free(prof->br_which);
+    free(prof);
+}
+
+/* --- Annotated listing --- */
+#define DETAIL_WIDTH 40
+
+// Pads by display columns: printf's %-*s counts bytes, and ENTÃO / SENÃO
+// are longer in UTF-8 than on screen
+static void print_detail(FILE* out, const char* detail) {
+    int width = 0;
+    for(const char* c = detail; *c; c++)
+        if(((unsigned char)*c & 0xC0) != 0x80) width++;   // not a continuation byte
+    fprintf(out, "%s%*s", detail, width < DETAIL_WIDTH ? DETAIL_WIDTH - width : 0, "");
+}
+
+static void listing_line(FILE* out, long long count, const char* detail, int depth) {
+    if(count >= 0) fprintf(out, "%12lld  ", count);
+    else fprintf(out, "%12s  ", "");
+    print_detail(out, detail);
+    fprintf(out, "  %*s", depth * 2, "");
+}
+
+static void listing(const Program* p, const Profile* prof, const Node* n, int depth, FILE* out) {
+    char detail[128];
+    for(; n; n = n->next){
+        detail[0] = 0;
+        if(n->kind == N_DO_WHILE){
+            snprintf(detail, sizeof(detail), "%lld iterations", prof->iters[n->id]);
+        } else if(n->kind == N_IF){
+            const long long* c = &prof->br_count[2 * n->id];
+            const long long* ns = &prof->br_ns[2 * n->id];
+            snprintf(detail, sizeof(detail), "ENTÃO %lld (%.1f us), SENÃO %lld (%.1f us)",
+                     c[0], ns[0] / 1e3, c[1], ns[1] / 1e3);
+        }
+
+        listing_line(out, prof->count[n->id], detail, depth);
+        print_stmt_head(p, n, out);
+        fprintf(out, "\n");
+
+        if(n->kind == N_IF){
+            listing(p, prof, n->body, depth + 1, out);
+            if(n->alt){
+                listing_line(out, -1, "", depth);
+                fprintf(out, "SENÃO\n");
+                listing(p, prof, n->alt, depth + 1, out);
+            }
+            listing_line(out, -1, "", depth);
+            fprintf(out, "FIM\n");
+        } else if(n->kind == N_DO_WHILE){
+            listing(p, prof, n->body, depth + 1, out);
+            listing_line(out, -1, "", depth);
+            fprintf(out, "ENQUANTO ");
+            print_expr(p, n->a, out);
+            fprintf(out, "\n");
+        }
+    }
+}
+
+void profile_listing(const Program* p, const Profile* prof, FILE* out) {
+    fprintf(out, "═══════════════════════════════════════════════════════════\n");
+    fprintf(out, "  Execution Profile\n");
+    if(p->opt.rounds) fprintf(out, "  (of the optimized program, run with -O0 to profile it as written)\n");
+    fprintf(out, "═══════════════════════════════════════════════════════════\n");
+    fprintf(out, "%12s  ", "count");
+    print_detail(out, "loop iterations / SE branches");
+    fprintf(out, "  statement\n");
+    listing(p, prof, p->ast, 0, out);
+}
+
+/* --- Folded stacks --- */
+// Frames are weighted by the bytecode instructions each statement executed
+// itself: its execution count (iterations for FAÇA) times its own code size.
+static void folded(const Program* p, const Profile* prof, const int* own,
+                   const Node* n, char* path, size_t plen, FILE* out) {
+    for(; n; n = n->next){
+        char* frame;
+        size_t flen;
+        FILE* f = open_memstream(&frame, &flen);
+        if(!f) return;
+        fprintf(f, "#%d ", n->id + 1);
+        print_stmt_head(p, n, f);
+        fclose(f);
+        for(char* c = frame; *c; c++) if(*c == ';') *c = ',';  // ';' separates frames
+
+        size_t len = plen + 1 + flen;
+        char* sub = malloc(len + 1);
+        if(!sub){ free(frame); return; }
+        memcpy(sub, path, plen);
+        sub[plen] = ';';
+        memcpy(sub + plen + 1, frame, flen + 1);
+        free(frame);
+
+        long long runs = (n->kind == N_DO_WHILE) ? prof->iters[n->id] : prof->count[n->id];
+        long long weight = runs * own[n->id];
+        if(weight > 0) fprintf(out, "%s %lld\n", sub, weight);
+
+        folded(p, prof, own, n->body, sub, len, out);
+        folded(p, prof, own, n->alt, sub, len, out);
+        free(sub);
+    }
+}
+
+void profile_folded(const Program* p, const Profile* prof, FILE* out) {
+    int* own = calloc(p->nstmts ? p->nstmts : 1, sizeof(int));
+    if(!own) return;
+    for(int i = 0; i < p->ncode; i++){
+        const Instr* in = &p->code[i];
+        if(in->op < OP_PROF_STMT && in->stmt < p->nstmts) own[in->stmt]++;
+    }
+    char root[] = "programa";
+    folded(p, prof, own, p->ast, root, strlen(root), out);
+    free(own);
+}
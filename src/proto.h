@@ -0,0 +1,51 @@
+// proto.h
+// Wire format shared by ./server and ./client. Messages travel over a Unix
+// domain socket, so lengths are in host byte order.
+//
+//   request:  u32 length | u8 kind | u8 flags | payload
+//             kind 'S': payload is X25a source text
+//             kind 'F': payload is a file path, read by the server; only
+//                       for clients running as the server's user
+//   response: u32 length | u8 status | u32 diag_len | diagnostics | tokens
+//             status is a CheckStatus; tokens only with PROTO_WANT_TOKENS
+
+#ifndef X25A_PROTO_H
+#define X25A_PROTO_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define PROTO_SOURCE 'S'
+#define PROTO_PATH   'F'
+
+#define PROTO_WANT_TOKENS 1
+
+#define PROTO_MAX_MSG (64u << 20)
+
+// Both return 1 on success, 0 on end of stream or error
+static inline int proto_read_all(int fd, void* buf, size_t n) {
+    char* p = buf;
+    while(n > 0){
+        ssize_t r = read(fd, p, n);
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) return 0;
+        p += r;
+        n -= r;
+    }
+    return 1;
+}
+
+static inline int proto_write_all(int fd, const void* buf, size_t n) {
+    const char* p = buf;
+    while(n > 0){
+        ssize_t w = write(fd, p, n);
+        if(w < 0 && errno == EINTR) continue;
+        if(w <= 0) return 0;
+        p += w;
+        n -= w;
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,246 @@
+// rtio.c
+// Buffered runtime I/O for LEIA/ESCREVA.
+// Regular input files are mmap'd whole; pipes and terminals are read in large
+// chunks. Output is collected in one big buffer and written in batches, so a
+// program costs a syscall per megabyte instead of one per value.
+//
+// Text mode:   LEIA reads whitespace-separated decimal integers,
+//              ESCREVA writes one value or message per line.
+// Binary mode: LEIA reads raw little-endian int64 values,
+//              ESCREVA writes them back the same way; messages are dropped.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "interp.h"
+
+#define RT_IN_BUFSIZE  (1 << 20)
+#define RT_OUT_BUFSIZE (1 << 20)
+
+int rt_in_open(RtIn* in, int fd, int binary, size_t bufsize) {
+    memset(in, 0, sizeof(*in));
+    in->fd = fd;
+    in->binary = binary;
+
+    struct stat st;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode)){
+        off_t off = lseek(fd, 0, SEEK_CUR);
+        if(off < 0) off = 0;
+        if(st.st_size <= off){
+            in->offset = off;
+            in->eof = 1;
+            in->mapped = 1;
+            return 1;
+        }
+        void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(m != MAP_FAILED){
+            madvise(m, st.st_size, MADV_SEQUENTIAL);
+            in->buf = m;
+            in->pos = off;      // offset stays 0: pos is the file offset
+            in->len = in->cap = st.st_size;
+            in->mapped = 1;
+            in->eof = 1;  // nothing left to fill
+            return 1;
+        }
+    }
+
+    off_t off = lseek(fd, 0, SEEK_CUR);
+    in->offset = (off > 0) ? off : 0;
+    in->cap = bufsize ? bufsize : RT_IN_BUFSIZE;
+    in->buf = malloc(in->cap);
+    return in->buf != NULL;
+}
+
+void rt_in_close(RtIn* in) {
+    if(in->mapped){
+        if(in->buf) munmap(in->buf, in->cap);
+    } else {
+        free(in->buf);
+    }
+    in->buf = NULL;
+}
+
+// Keep the unread tail [pos, len) and append more input after it.
+// Returns 1 if input was added, 0 at end of input, RT_AGAIN if a
+// non-blocking descriptor has nothing to read yet.
+static int rt_fill(RtIn* in) {
+    if(in->eof) return 0;
+    if(in->tie) rt_flush(in->tie);
+
+    if(in->pos > 0){
+        memmove(in->buf, in->buf + in->pos, in->len - in->pos);
+        in->offset += in->pos;
+        in->len -= in->pos;
+        in->pos = 0;
+    }
+    if(in->len == in->cap) return 0;  // a single token larger than the buffer
+
+    ssize_t n;
+    do {
+        n = read(in->fd, in->buf + in->len, in->cap - in->len);
+    } while(n < 0 && errno == EINTR);
+
+    if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return RT_AGAIN;
+    if(n == 0 && in->no_writer) return RT_AGAIN;
+    if(n <= 0){
+        in->eof = 1;
+        return 0;
+    }
+    in->len += n;
+    in->no_writer = 0;
+    return 1;
+}
+
+static inline int is_space(unsigned char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+static inline int is_digit(unsigned char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+static size_t scan_number(const RtIn* in) {
+    size_t end = in->pos;
+    if(end < in->len && (in->buf[end] == '-' || in->buf[end] == '+')) end++;
+    while(end < in->len && is_digit(in->buf[end])) end++;
+    return end;
+}
+
+// An optional sign and decimal digits filling [p, e) exactly; anything
+// else, or a value outside the int64 range, is malformed
+int rt_parse_value(const char* p, const char* e, Value* v) {
+    int neg = 0;
+    if(p < e && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+    if(p == e) return -1;
+    uint64_t limit = neg ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    uint64_t u = 0;
+    while(p < e){
+        unsigned d = (unsigned char)(*p++ - '0');
+        if(d > 9 || u > (limit - d) / 10) return -1;
+        u = u * 10 + d;
+    }
+    *v = (Value)(neg ? 0 - u : u);
+    return 1;
+}
+
+// Nothing is consumed unless a whole value is returned, so after RT_AGAIN
+// the call can simply be repeated once the descriptor is readable
+int rt_read_value(RtIn* in, Value* v) {
+    int r = 0;
+    if(in->binary){
+        while(in->len - in->pos < 8){
+            if((r = rt_fill(in)) == RT_AGAIN) return RT_AGAIN;
+            if(!r) return (in->len == in->pos) ? 0 : -1;
+        }
+        const unsigned char* p = in->buf + in->pos;
+        uint64_t u = 0;
+        for(int i = 7; i >= 0; i--) u = (u << 8) | p[i];
+        in->pos += 8;
+        *v = (Value)u;
+        return 1;
+    }
+
+    // skip separators
+    for(;;){
+        while(in->pos < in->len && is_space(in->buf[in->pos])) in->pos++;
+        if(in->pos < in->len) break;
+        if((r = rt_fill(in)) == RT_AGAIN) return RT_AGAIN;
+        if(!r) return 0;
+    }
+
+    // make sure the whole number is in the buffer before converting it;
+    // rt_fill compacts the buffer even when no more input arrives, so rescan
+    size_t end;
+    do {
+        end = scan_number(in);
+    } while(end == in->len && (r = rt_fill(in)) == 1);
+    if(end == in->len && r == RT_AGAIN) return RT_AGAIN;
+    end = scan_number(in);
+
+    if(end < in->len && !is_space(in->buf[end])) return -1;
+    if(rt_parse_value((const char*)in->buf + in->pos, (const char*)in->buf + end, v) < 0) return -1;
+    in->pos = end;
+    return 1;
+}
+
+int rt_out_open(RtOut* out, int fd, int binary, size_t bufsize) {
+    memset(out, 0, sizeof(*out));
+    out->fd = fd;
+    out->binary = binary;
+
+    // appending (>>) writes at the end whatever the current position says
+    struct stat st;
+    off_t off = lseek(fd, 0, SEEK_CUR);
+    if((fcntl(fd, F_GETFL) & O_APPEND) && fstat(fd, &st) == 0) off = st.st_size;
+    out->offset = (off > 0) ? off : 0;
+    out->cap = bufsize ? bufsize : RT_OUT_BUFSIZE;
+    out->buf = malloc(out->cap);
+    return out->buf != NULL;
+}
+
+void rt_out_close(RtOut* out) {
+    rt_flush(out);
+    free(out->buf);
+    out->buf = NULL;
+}
+
+static void rt_write_all(RtOut* out, const unsigned char* p, size_t n) {
+    while(n > 0 && !out->error){
+        ssize_t w = write(out->fd, p, n);
+        if(w < 0){
+            if(errno == EINTR) continue;
+            out->error = 1;
+            break;
+        }
+        p += w;
+        n -= w;
+        out->offset += w;
+    }
+}
+
+int rt_flush(RtOut* out) {
+    if(out->len > 0) rt_write_all(out, out->buf, out->len);
+    out->len = 0;
+    return out->error ? -1 : 0;
+}
+
+void rt_write_value(RtOut* out, Value v) {
+    if(out->cap - out->len < 32) rt_flush(out);
+    unsigned char* p = out->buf + out->len;
+
+    if(out->binary){
+        uint64_t u = (uint64_t)v;
+        for(int i = 0; i < 8; i++){ p[i] = (unsigned char)u; u >>= 8; }
+        out->len += 8;
+        return;
+    }
+
+    char tmp[24];
+    int n = 0;
+    uint64_t u = (v < 0) ? 0 - (uint64_t)v : (uint64_t)v;
+    do { tmp[n++] = (char)('0' + u % 10); u /= 10; } while(u);
+    if(v < 0) *p++ = '-';
+    while(n) *p++ = tmp[--n];
+    *p++ = '\n';
+    out->len = p - out->buf;
+}
+
+void rt_write_str(RtOut* out, const char* s, size_t n) {
+    if(out->binary) return;
+    if(out->cap - out->len < n + 1){
+        rt_flush(out);
+        if(out->cap < n + 1){
+            rt_write_all(out, (const unsigned char*)s, n);
+            rt_write_all(out, (const unsigned char*)"\n", 1);
+            return;
+        }
+    }
+    memcpy(out->buf + out->len, s, n);
+    out->buf[out->len + n] = '\n';
+    out->len += n + 1;
+}
@@ -0,0 +1,442 @@
+// sched.c
+// Runs many X25a programs at once on a small pool of OS threads.
+// Every program is a job with its own VM (variable frame and stack) and
+// small I/O buffers, so memory per job is bounded. Jobs run in slices of a
+// fixed instruction budget; a job whose LEIA would block is parked until its
+// input is readable. Each worker has its own queue and steals from the others
+// when it runs dry.
+// Usage: ./sched [-j threads] [-q budget] [-b] jobs.txt
+//   jobs.txt: one job per line, "tokens.lex input-file output-file"
+// Inputs may be FIFOs; a job reading a FIFO before any writer opened it is
+// parked until one does, and reaches end of input once the writers close it.
+// Outputs must be regular files.
+// Only as many jobs as the descriptor limit allows are open at once; the
+// others wait, unopened, and are admitted one by one as running jobs finish.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "interp.h"
+
+#define JOB_BUFSIZE 4096
+#define DEFAULT_BUDGET 10000
+
+typedef struct {
+    const Program* prog;
+    char* input;
+    char* output;
+    VM vm;
+    RtIn in;
+    RtOut out;
+    int in_fd, out_fd;
+    int line;           // line in the jobs file, for messages
+    int polled;         // in_fd is registered with epoll
+    atomic_int hangup;  // set by the poller; only the running worker touches in
+} Job;
+
+// Ring buffer: the owner pops from the front and pushes to the back,
+// thieves take from the back
+typedef struct {
+    pthread_mutex_t lock;
+    Job** items;
+    size_t head, count, cap;
+} Deque;
+
+typedef struct Cached {
+    char* path;
+    Program prog;
+    int ok;
+    struct Cached* next;
+} Cached;
+
+static Deque* queues;
+static int nthreads = 1;
+static long long budget = DEFAULT_BUDGET;
+static int binary;
+
+// Jobs not admitted yet, in jobs file order
+static Job** pending;
+static size_t npending, next_pending;
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static atomic_long queued;          // jobs sitting in any deque
+static atomic_long live;            // jobs not finished yet
+static atomic_int failed;
+static atomic_long slices, parks, steals;
+static atomic_uint next_queue;
+
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static int done;
+
+static int epfd, wakefd;
+
+static void deque_push(Deque* d, Job* j) {
+    pthread_mutex_lock(&d->lock);
+    if(d->count == d->cap){
+        size_t cap = d->cap ? d->cap * 2 : 64;
+        Job** items = malloc(sizeof(Job*) * cap);
+        if(!items){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+        for(size_t i = 0; i < d->count; i++) items[i] = d->items[(d->head + i) % d->cap];
+        free(d->items);
+        d->items = items;
+        d->head = 0;
+        d->cap = cap;
+    }
+    d->items[(d->head + d->count++) % d->cap] = j;
+    pthread_mutex_unlock(&d->lock);
+
+    atomic_fetch_add(&queued, 1);
+    pthread_mutex_lock(&idle_lock);
+    pthread_cond_signal(&idle_cond);
+    pthread_mutex_unlock(&idle_lock);
+}
+
+static Job* deque_pop(Deque* d, int back) {
+    Job* j = NULL;
+    pthread_mutex_lock(&d->lock);
+    if(d->count > 0){
+        if(back){
+            j = d->items[(d->head + d->count - 1) % d->cap];
+        } else {
+            j = d->items[d->head];
+            d->head = (d->head + 1) % d->cap;
+        }
+        d->count--;
+    }
+    pthread_mutex_unlock(&d->lock);
+    if(j) atomic_fetch_sub(&queued, 1);
+    return j;
+}
+
+static Job* steal(int self) {
+    for(int k = 1; k < nthreads; k++){
+        Job* j = deque_pop(&queues[(self + k) % nthreads], 1);
+        if(j){
+            atomic_fetch_add(&steals, 1);
+            return j;
+        }
+    }
+    return NULL;
+}
+
+// Returns 0 once every job has finished
+static int wait_for_work() {
+    pthread_mutex_lock(&idle_lock);
+    while(atomic_load(&queued) == 0 && !done) pthread_cond_wait(&idle_cond, &idle_lock);
+    int more = !done;
+    pthread_mutex_unlock(&idle_lock);
+    return more;
+}
+
+static void admit_next();
+
+static void job_gone() {
+    if(atomic_fetch_sub(&live, 1) == 1){
+        pthread_mutex_lock(&idle_lock);
+        done = 1;
+        pthread_cond_broadcast(&idle_cond);
+        pthread_mutex_unlock(&idle_lock);
+        uint64_t one = 1;
+        if(write(wakefd, &one, sizeof(one)) < 0) perror("write");
+    }
+}
+
+static void free_job(Job* j) {
+    free(j->input);
+    free(j->output);
+    free(j);
+}
+
+static void finish_job(Job* j, VmStatus st) {
+    if(st == VM_ERROR){
+        fprintf(stderr, "  job at line %d failed\n", j->line);
+        atomic_fetch_add(&failed, 1);
+    }
+    if(j->polled) epoll_ctl(epfd, EPOLL_CTL_DEL, j->in_fd, NULL);
+    rt_out_close(&j->out);
+    if(j->out.error){
+        fprintf(stderr, "  job at line %d: write error\n", j->line);
+        atomic_fetch_add(&failed, 1);
+    }
+    rt_in_close(&j->in);
+    vm_free(&j->vm);
+    if(j->in_fd >= 0) close(j->in_fd);
+    close(j->out_fd);
+    free_job(j);
+
+    admit_next();   // its descriptors are free again
+    job_gone();
+}
+
+// Once epoll_ctl succeeds the poller may hand the job to another worker,
+// which can finish and free it: the job must not be touched after that
+static void park(Job* j) {
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = j };
+    int op = j->polled ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    atomic_fetch_add(&parks, 1);
+    j->polled = 1;
+    if(epoll_ctl(epfd, op, j->in_fd, &ev) == 0) return;
+    perror("epoll_ctl");
+    if(op == EPOLL_CTL_ADD) j->polled = 0;
+    finish_job(j, VM_ERROR);
+}
+
+static void* worker(void* arg) {
+    int self = (int)(intptr_t)arg;
+    for(;;){
+        Job* j = deque_pop(&queues[self], 0);
+        if(!j) j = steal(self);
+        if(!j){
+            if(!wait_for_work()) break;
+            continue;
+        }
+
+        // a FIFO only reports a hangup after a writer has come and gone
+        if(atomic_exchange(&j->hangup, 0)) j->in.no_writer = 0;
+        atomic_fetch_add(&slices, 1);
+        VmStatus st = vm_run(&j->vm, budget);
+        switch(st){
+            case VM_YIELD: deque_push(&queues[self], j); break;
+            case VM_BLOCKED: park(j); break;
+            default: finish_job(j, st); break;
+        }
+    }
+    return NULL;
+}
+
+// Hands jobs whose input became readable back to the workers
+static void* poller(void* arg) {
+    (void)arg;
+    struct epoll_event evs[256];
+    for(;;){
+        int n = epoll_wait(epfd, evs, 256, -1);
+        for(int i = 0; i < n; i++){
+            if(evs[i].data.ptr == NULL) return NULL;  // wakefd: all jobs done
+            Job* j = evs[i].data.ptr;
+            if(evs[i].events & EPOLLHUP) atomic_store(&j->hangup, 1);
+            unsigned q = atomic_fetch_add(&next_queue, 1) % nthreads;
+            deque_push(&queues[q], j);
+        }
+    }
+}
+
+static Cached* programs;
+
+static const Program* load_program(const char* path) {
+    for(Cached* c = programs; c; c = c->next)
+        if(strcmp(c->path, path) == 0) return c->ok ? &c->prog : NULL;
+
+    Cached* c = calloc(1, sizeof(Cached));
+    if(!c) return NULL;
+    c->path = strdup(path);
+    c->next = programs;
+    programs = c;
+
+    FILE* f = fopen(path, "r");
+    if(!f){
+        fprintf(stderr, "Error: Cannot open '%s'\n", path);
+        return NULL;
+    }
+    c->ok = compile_program(f, &c->prog, COMPILE_OPTIMIZE);
+    fclose(f);
+    if(!c->ok) fprintf(stderr, "Error: '%s' has syntax errors, run ./parser for details\n", path);
+    return c->ok ? &c->prog : NULL;
+}
+
+static Job* new_job(const char* tokens, const char* input, const char* output, int line) {
+    const Program* p = load_program(tokens);
+    if(!p) return NULL;
+
+    Job* j = calloc(1, sizeof(Job));
+    if(!j){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+    j->prog = p;
+    j->line = line;
+    j->in_fd = j->out_fd = -1;
+    j->input = strdup(input);
+    j->output = strdup(output);
+    if(!j->input || !j->output){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+    return j;
+}
+
+// Opens the job's files and sets up its VM, right before it first runs
+static int open_job(Job* j) {
+    j->in_fd = open(j->input, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if(j->in_fd < 0){
+        fprintf(stderr, "Error: Cannot open '%s': %s\n", j->input, strerror(errno));
+        return 0;
+    }
+    // writes are blocking, so a FIFO or device as output could hold a worker
+    // forever; O_NONBLOCK only keeps the open itself from waiting for a reader
+    struct stat st;
+    j->out_fd = open(j->output, O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK | O_CLOEXEC, 0644);
+    if(j->out_fd < 0 && errno != ENXIO){
+        fprintf(stderr, "Error: Cannot open '%s': %s\n", j->output, strerror(errno));
+        close(j->in_fd);
+        return 0;
+    }
+    if(j->out_fd < 0 || fstat(j->out_fd, &st) < 0 || !S_ISREG(st.st_mode)){
+        fprintf(stderr, "Error: output '%s' must be a regular file\n", j->output);
+        if(j->out_fd >= 0) close(j->out_fd);
+        close(j->in_fd);
+        return 0;
+    }
+    fcntl(j->out_fd, F_SETFL, 0);
+    if(!rt_in_open(&j->in, j->in_fd, binary, JOB_BUFSIZE) ||
+       !rt_out_open(&j->out, j->out_fd, binary, JOB_BUFSIZE) ||
+       !vm_init(&j->vm, j->prog, &j->in, &j->out)){
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    j->in.tie = &j->out;    // whoever feeds the input may be waiting for this output
+    // a mapped input never blocks and no longer needs its descriptor
+    if(j->in.mapped){
+        close(j->in_fd);
+        j->in_fd = -1;
+    } else if(fstat(j->in_fd, &st) == 0 && S_ISFIFO(st.st_mode)){
+        j->in.no_writer = 1;
+    }
+    return 1;
+}
+
+// Opens the next waiting job and queues it; jobs that cannot be opened
+// count as failed and the one after them is tried instead
+static void admit_next() {
+    for(;;){
+        pthread_mutex_lock(&pending_lock);
+        Job* j = next_pending < npending ? pending[next_pending++] : NULL;
+        pthread_mutex_unlock(&pending_lock);
+        if(!j) return;
+
+        if(open_job(j)){
+            unsigned q = atomic_fetch_add(&next_queue, 1) % nthreads;
+            deque_push(&queues[q], j);
+            return;
+        }
+        fprintf(stderr, "  job at line %d failed\n", j->line);
+        atomic_fetch_add(&failed, 1);
+        free_job(j);
+        job_gone();
+    }
+}
+
+int main(int argc, char** argv){
+    int opt;
+    nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    while((opt = getopt(argc, argv, "j:q:b")) != -1){
+        switch(opt){
+            case 'j': nthreads = atoi(optarg); break;
+            case 'q': budget = atoll(optarg); break;
+            case 'b': binary = 1; break;
+            default: goto usage;
+        }
+    }
+    if(optind >= argc || nthreads < 1 || budget < 1) goto usage;
+
+    FILE* jf = fopen(argv[optind], "r");
+    if(!jf){
+        fprintf(stderr, "Error: Cannot open '%s'\n", argv[optind]);
+        perror("fopen");
+        return 1;
+    }
+
+    // a running job holds its output descriptor, and its input unless it is
+    // mapped; keep some descriptors for everything else
+    long max_open = 1024;
+    struct rlimit rl;
+    if(getrlimit(RLIMIT_NOFILE, &rl) == 0){
+        if(rl.rlim_cur < rl.rlim_max){
+            rl.rlim_cur = rl.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &rl);
+            getrlimit(RLIMIT_NOFILE, &rl);
+        }
+        if(rl.rlim_cur != RLIM_INFINITY) max_open = (long)rl.rlim_cur;
+    }
+    long max_running = (max_open - 32) / 2;
+    if(max_running < 1) max_running = 1;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    wakefd = eventfd(0, EFD_CLOEXEC);
+    struct epoll_event wake = { .events = EPOLLIN, .data.ptr = NULL };
+    if(epfd < 0 || wakefd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &wake) < 0){
+        perror("epoll");
+        return 1;
+    }
+
+    queues = calloc(nthreads, sizeof(Deque));
+    for(int i = 0; i < nthreads; i++) pthread_mutex_init(&queues[i].lock, NULL);
+
+    // read every job first, so syntax errors show up before anything runs
+    size_t cap = 0;
+    char line[4096], tok[1024], in[1024], out[1024];
+    int lineno = 0, njobs = 0;
+    while(fgets(line, sizeof(line), jf)){
+        lineno++;
+        if(line[0] == '#' || line[strspn(line, " \t\r\n")] == 0) continue;
+        if(sscanf(line, "%1023s %1023s %1023s", tok, in, out) != 3){
+            fprintf(stderr, "Error: line %d: expected 'tokens.lex input output'\n", lineno);
+            failed++;
+            continue;
+        }
+        Job* j = new_job(tok, in, out, lineno);
+        if(!j){
+            failed++;
+            continue;
+        }
+        if(npending == cap){
+            cap = cap ? cap * 2 : 64;
+            pending = realloc(pending, sizeof(Job*) * cap);
+            if(!pending){ fprintf(stderr, "Error: out of memory\n"); return 1; }
+        }
+        pending[npending++] = j;
+    }
+    fclose(jf);
+    njobs = (int)npending;
+    atomic_store(&live, njobs);
+    for(long i = 0; i < max_running && next_pending < npending; i++) admit_next();
+
+    if(njobs > 0){
+        pthread_t poll_thread;
+        pthread_t* pool = malloc(sizeof(pthread_t) * nthreads);
+        pthread_create(&poll_thread, NULL, poller, NULL);
+        for(int i = 0; i < nthreads; i++)
+            pthread_create(&pool[i], NULL, worker, (void*)(intptr_t)i);
+        for(int i = 0; i < nthreads; i++) pthread_join(pool[i], NULL);
+        pthread_join(poll_thread, NULL);
+        free(pool);
+    }
+
+    fprintf(stderr, "Ran %d jobs on %d threads: %ld slices, %ld parked on input, %ld stolen, %d failed\n",
+            njobs, nthreads, (long)slices, (long)parks, (long)steals, (int)failed);
+
+    for(Cached* c = programs; c;){
+        Cached* next = c->next;
+        if(c->ok) free_program(&c->prog);
+        free(c->path);
+        free(c);
+        c = next;
+    }
+    for(int i = 0; i < nthreads; i++) free(queues[i].items);
+    free(queues);
+    free(pending);
+    return failed ? 1 : 0;
+
+usage:
+    fprintf(stderr, "Usage: %s [-j threads] [-q budget] [-b] jobs.txt\n", argv[0]);
+    fprintf(stderr, "  jobs.txt: one job per line, 'tokens.lex input-file output-file' (output must be a regular file)\n");
+    fprintf(stderr, "  -j: worker threads (default: one per CPU)\n");
+    fprintf(stderr, "  -q: instructions per time slice (default: %d)\n", DEFAULT_BUDGET);
+    fprintf(stderr, "  -b: binary I/O for every job\n");
+    return 1;
+}
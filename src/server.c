@@ -0,0 +1,374 @@
+// server.c
+// Long-running check server: lexes and parses X25a sources sent over a Unix
+// domain socket and answers with the diagnostics (see proto.h).
+// Avoids paying process startup and temp files for every check.
+// The main thread watches every connection with epoll and hands each complete
+// request to the worker pool, so an idle connection does not hold a thread.
+// Path requests read files with the server's privileges, so the socket is
+// only accessible to the user running the server, and a path request from
+// any other user (root can still connect) is refused.
+// Usage: ./server [-j threads] socket-path
+
+#define _GNU_SOURCE     // struct ucred
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "check.h"
+#include "proto.h"
+
+#define CACHE_SLOTS 1024
+#define SEND_TIMEOUT 10     // seconds a worker waits for a client that stopped reading
+
+// Results are cached by source contents, so repeated checks of an unchanged
+// file (by text or by path) skip the lexer and parser entirely
+typedef struct {
+    uint64_t hash;
+    char* src;
+    size_t len;
+    CheckResult res;
+} CacheEntry;
+
+static CacheEntry cache[CACHE_SLOTS];
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int listen_fd = -1;
+static int epfd = -1;
+static const char* socket_path;
+
+typedef struct {
+    char* data;
+    size_t len, cap;
+} Buf;
+
+// Owned by the epoll thread while it waits for a full request, then by the
+// worker answering it; the descriptor is armed EPOLLONESHOT, so never both
+typedef struct Conn {
+    int fd;
+    Buf in;                 // received bytes, starting at a request
+    int eof;                // the client closed its end or the socket failed
+    int trusted;            // the peer runs as the server's user, may send paths
+    struct Conn* next;      // in the request queue
+} Conn;
+
+static Conn* queue_head;
+static Conn** queue_tail = &queue_head;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static void buf_reserve(Buf* b, size_t n) {
+    if(b->cap >= n) return;
+    size_t cap = b->cap ? b->cap : 4096;
+    while(cap < n) cap *= 2;
+    char* p = realloc(b->data, cap);
+    if(!p){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+    b->data = p;
+    b->cap = cap;
+}
+
+static void buf_append(Buf* b, const void* p, size_t n) {
+    buf_reserve(b, b->len + n);
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static uint64_t fnv1a(const char* s, size_t n) {
+    uint64_t h = 1469598103934665603ull;
+    for(size_t i = 0; i < n; i++){
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// Response body: u8 status | u32 diag_len | diagnostics | [tokens]
+static void build_response(Buf* resp, const CheckResult* r, int flags) {
+    uint32_t diag_len = (uint32_t)r->diag_len;
+    uint32_t total = 1 + 4 + diag_len;
+    if(flags & PROTO_WANT_TOKENS) total += (uint32_t)r->tokens_len;
+
+    uint8_t status = (uint8_t)r->status;
+    resp->len = 0;
+    buf_reserve(resp, 4 + total);
+    buf_append(resp, &total, 4);
+    buf_append(resp, &status, 1);
+    buf_append(resp, &diag_len, 4);
+    buf_append(resp, r->diag, r->diag_len);
+    if(flags & PROTO_WANT_TOKENS) buf_append(resp, r->tokens, r->tokens_len);
+}
+
+static void check_cached(const char* src, size_t len, int flags, Buf* resp) {
+    uint64_t h = fnv1a(src, len);
+    CacheEntry* e = &cache[h % CACHE_SLOTS];
+
+    pthread_mutex_lock(&cache_lock);
+    if(e->src && e->hash == h && e->len == len && memcmp(e->src, src, len) == 0){
+        build_response(resp, &e->res, flags);
+        pthread_mutex_unlock(&cache_lock);
+        return;
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    CheckResult r;
+    check_source(src, len, &r);
+    build_response(resp, &r, flags);
+
+    char* copy = malloc(len ? len : 1);
+    if(!copy || r.status == CHECK_FAILED){
+        free(copy);
+        check_result_free(&r);
+        return;
+    }
+    memcpy(copy, src, len);
+
+    pthread_mutex_lock(&cache_lock);
+    free(e->src);
+    check_result_free(&e->res);
+    e->hash = h;
+    e->src = copy;
+    e->len = len;
+    e->res = r;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+static int read_file(const char* path, Buf* out) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return 0;
+    struct stat st;
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size > PROTO_MAX_MSG){
+        close(fd);
+        errno = EINVAL;
+        return 0;
+    }
+    out->len = 0;
+    buf_reserve(out, st.st_size + 1);
+    ssize_t n = 0;
+    while(out->len < (size_t)st.st_size && (n = read(fd, out->data + out->len, st.st_size - out->len)) > 0)
+        out->len += n;
+    close(fd);
+    return n >= 0;
+}
+
+static void fail_response(Buf* resp, const char* path, int err) {
+    char msg[600];
+    snprintf(msg, sizeof(msg), "Error: Cannot open '%s': %s\n", path, strerror(err));
+    CheckResult r = { .status = CHECK_FAILED, .diag = msg, .diag_len = strlen(msg) };
+    build_response(resp, &r, 0);
+}
+
+static void close_conn(Conn* c) {
+    close(c->fd);
+    free(c->in.data);
+    free(c);
+}
+
+// Size of the request at the front of the buffer: 0 while incomplete,
+// (size_t)-1 if the header is invalid
+static size_t request_size(const Conn* c) {
+    uint32_t len;
+    if(c->in.len < 4) return 0;
+    memcpy(&len, c->in.data, 4);
+    if(len < 2 || len > PROTO_MAX_MSG) return (size_t)-1;
+    return c->in.len >= 4 + (size_t)len ? 4 + (size_t)len : 0;
+}
+
+// Queues the connection if a whole request is buffered, otherwise waits
+// for more input; a connection can carry any number of requests
+static void dispatch(Conn* c) {
+    size_t n = request_size(c);
+    if(n == (size_t)-1 || (n == 0 && c->eof)){
+        close_conn(c);
+        return;
+    }
+    if(n > 0){
+        pthread_mutex_lock(&queue_lock);
+        c->next = NULL;
+        *queue_tail = c;
+        queue_tail = &c->next;
+        pthread_cond_signal(&queue_cond);
+        pthread_mutex_unlock(&queue_lock);
+        return;
+    }
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = c };
+    if(epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev) < 0) close_conn(c);
+}
+
+static void receive(Conn* c) {
+    while(request_size(c) == 0){
+        buf_reserve(&c->in, c->in.len + 4096);
+        ssize_t r = recv(c->fd, c->in.data + c->in.len, c->in.cap - c->in.len, MSG_DONTWAIT);
+        if(r > 0){
+            c->in.len += r;
+        } else if(r < 0 && errno == EINTR){
+            continue;
+        } else {
+            if(r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) c->eof = 1;
+            break;
+        }
+    }
+    dispatch(c);
+}
+
+// Answers the request at the front of the buffer; 0 if the connection is done
+static int serve_request(Conn* c, Buf* file, Buf* resp) {
+    uint32_t len;
+    memcpy(&len, c->in.data, 4);
+    // the payload is used as a string: borrow the first byte of the next request
+    buf_reserve(&c->in, 4 + (size_t)len + 1);
+    char* req = c->in.data + 4;
+    char saved = req[len];
+    req[len] = 0;
+
+    char kind = req[0];
+    int flags = (unsigned char)req[1];
+    const char* payload = req + 2;
+    size_t plen = len - 2;
+
+    int ok = 1;
+    if(kind == PROTO_SOURCE){
+        check_cached(payload, plen, flags, resp);
+    } else if(kind == PROTO_PATH){
+        if(!c->trusted) fail_response(resp, payload, EACCES);
+        else if(read_file(payload, file)) check_cached(file->data, file->len, flags, resp);
+        else fail_response(resp, payload, errno);
+    } else {
+        ok = 0;
+    }
+    req[len] = saved;
+    if(!ok || !proto_write_all(c->fd, resp->data, resp->len)) return 0;
+
+    c->in.len -= 4 + len;
+    memmove(c->in.data, req + len, c->in.len);
+    return 1;
+}
+
+static void* worker(void* arg) {
+    (void)arg;
+    Buf file = {0}, resp = {0};
+    for(;;){
+        pthread_mutex_lock(&queue_lock);
+        while(!queue_head) pthread_cond_wait(&queue_cond, &queue_lock);
+        Conn* c = queue_head;
+        queue_head = c->next;
+        if(!queue_head) queue_tail = &queue_head;
+        pthread_mutex_unlock(&queue_lock);
+
+        if(serve_request(c, &file, &resp)) dispatch(c);
+        else close_conn(c);
+    }
+    return NULL;
+}
+
+static void accept_all() {
+    for(;;){
+        int fd = accept(listen_fd, NULL, NULL);
+        if(fd < 0){
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+            return;
+        }
+        // responses are written blocking; don't let a client that stopped
+        // reading keep a worker forever
+        struct timeval tv = { .tv_sec = SEND_TIMEOUT };
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        Conn* c = calloc(1, sizeof(Conn));
+        if(!c){
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        struct ucred cred;
+        socklen_t clen = sizeof(cred);
+        c->trusted = getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &clen) == 0 && cred.uid == geteuid();
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = c };
+        if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0){
+            perror("epoll_ctl");
+            close_conn(c);
+        }
+    }
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    unlink(socket_path);
+    _exit(0);
+}
+
+int main(int argc, char** argv){
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while((opt = getopt(argc, argv, "j:")) != -1){
+        switch(opt){
+            case 'j': threads = atol(optarg); break;
+            default: goto usage;
+        }
+    }
+    if(optind >= argc || threads < 1) goto usage;
+    socket_path = argv[optind];
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if(strlen(socket_path) >= sizeof(addr.sun_path)){
+        fprintf(stderr, "Error: socket path too long\n");
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listen_fd < 0){ perror("socket"); return 1; }
+    unlink(socket_path);
+    mode_t mask = umask(0077);      // the socket is created 0600
+    int bound = bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(mask);
+    if(bound < 0){ perror("bind"); return 1; }
+    if(listen(listen_fd, SOMAXCONN) < 0){ perror("listen"); return 1; }
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event lev = { .events = EPOLLIN, .data.ptr = NULL };
+    if(epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &lev) < 0){ perror("epoll"); return 1; }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    fprintf(stderr, "Listening on %s with %ld threads\n", socket_path, threads);
+
+    pthread_t* pool = malloc(sizeof(pthread_t) * threads);
+    for(long i = 0; i < threads; i++){
+        if(pthread_create(&pool[i], NULL, worker, NULL) != 0){
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    struct epoll_event evs[256];
+    for(;;){
+        int n = epoll_wait(epfd, evs, 256, -1);
+        if(n < 0){
+            if(errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for(int i = 0; i < n; i++){
+            if(evs[i].data.ptr) receive(evs[i].data.ptr);
+            else accept_all();
+        }
+    }
+
+    unlink(socket_path);
+    return 1;
+
+usage:
+    fprintf(stderr, "Usage: %s [-j threads] socket-path\n", argv[0]);
+    fprintf(stderr, "  -j: worker threads answering requests (default: one per CPU)\n");
+    return 1;
+}
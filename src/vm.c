@@ -0,0 +1,131 @@
+// vm.c
+// Stack-based bytecode interpreter for compiled X25a programs
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "interp.h"
+
+int vm_init(VM* vm, const Program* p, RtIn* in, RtOut* out) {
+    memset(vm, 0, sizeof(*vm));
+    vm->prog = p;
+    vm->in = in;
+    vm->out = out;
+    vm->vars = calloc(p->nvars ? p->nvars : 1, sizeof(Value));
+    vm->stack = calloc(p->max_stack ? p->max_stack : 1, sizeof(Value));
+    return vm->vars && vm->stack;
+}
+
+void vm_free(VM* vm) {
+    free(vm->vars);
+    free(vm->stack);
+    vm->vars = vm->stack = NULL;
+}
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void runtime_error(VM* vm, const char* msg) {
+    const Instr* i = &vm->prog->code[vm->pc];
+    fprintf(stderr, "RUNTIME ERROR: %s (statement #%d, pc %d)\n", msg, i->stmt + 1, vm->pc);
+}
+
+VmStatus vm_run(VM* vm, long long budget) {
+    const Instr* code = vm->prog->code;
+    Value* vars = vm->vars;
+    Value* sp = vm->stack + vm->sp;   // points one past the top
+    int pc = vm->pc;
+    long long steps = 0;
+    VmStatus status = VM_DONE;
+    if(budget <= 0) budget = LLONG_MAX;
+
+    for(;;){
+        const Instr* i = &code[pc];
+        steps++;
+        switch(i->op){
+            case OP_HALT:
+                goto out;
+            case OP_PUSH: *sp++ = i->arg; pc++; break;
+            case OP_LOAD: *sp++ = vars[i->arg]; pc++; break;
+            case OP_STORE: vars[i->arg] = *--sp; pc++; break;
+            case OP_ADD: sp--; sp[-1] = (Value)((uint64_t)sp[-1] + (uint64_t)sp[0]); pc++; break;
+            case OP_SUB: sp--; sp[-1] = (Value)((uint64_t)sp[-1] - (uint64_t)sp[0]); pc++; break;
+            case OP_MUL: sp--; sp[-1] = (Value)((uint64_t)sp[-1] * (uint64_t)sp[0]); pc++; break;
+            case OP_DIV:
+                sp--;
+                if(sp[0] == 0){
+                    vm->pc = pc;
+                    runtime_error(vm, "division by zero");
+                    status = VM_ERROR;
+                    goto out;
+                }
+                sp[-1] = (sp[0] == -1) ? (Value)(0 - (uint64_t)sp[-1]) : sp[-1] / sp[0];
+                pc++;
+                break;
+            case OP_LT: sp--; sp[-1] = sp[-1] < sp[0]; pc++; break;
+            case OP_EQ: sp--; sp[-1] = sp[-1] == sp[0]; pc++; break;
+            case OP_JZ: pc = (*--sp == 0) ? (int)i->arg : pc + 1; break;
+            case OP_JNZ:
+                if(*--sp == 0){ pc++; break; }
+                pc = (int)i->arg;
+                // only loops branch backwards, so this bounds every slice
+                if(steps >= budget){
+                    status = VM_YIELD;
+                    goto out;
+                }
+                break;
+            case OP_JMP: pc = (int)i->arg; break;
+            case OP_READ: {
+                Value v;
+                int r = rt_read_value(vm->in, &v);
+                if(r == RT_AGAIN){
+                    status = VM_BLOCKED;
+                    goto out;
+                }
+                if(r < 0){
+                    vm->pc = pc;
+                    runtime_error(vm, "malformed input value");
+                    status = VM_ERROR;
+                    goto out;
+                }
+                vars[i->arg] = (r > 0) ? v : 0;  // end of input reads as zero
+                pc++;
+                break;
+            }
+            case OP_WRITE: rt_write_value(vm->out, vars[i->arg]); pc++; break;
+            case OP_WRITES: {
+                const char* s = vm->prog->strs[i->arg];
+                rt_write_str(vm->out, s, strlen(s));
+                pc++;
+                break;
+            }
+
+            // Instrumentation: only present in code compiled for profiling
+            case OP_PROF_STMT: vm->prof->count[i->stmt]++; pc++; break;
+            case OP_PROF_ITER: vm->prof->iters[i->stmt]++; pc++; break;
+            case OP_PROF_BR:
+                vm->prof->br_which[i->stmt] = (int)i->arg;
+                vm->prof->br_count[2 * i->stmt + i->arg]++;
+                vm->prof->br_start[i->stmt] = now_ns();
+                pc++;
+                break;
+            case OP_PROF_BR_END: {
+                int s = i->stmt;
+                vm->prof->br_ns[2 * s + vm->prof->br_which[s]] += now_ns() - vm->prof->br_start[s];
+                pc++;
+                break;
+            }
+        }
+    }
+
+out:
+    vm->pc = pc;
+    vm->sp = sp - vm->stack;
+    vm->steps += steps;
+    return status;
+}
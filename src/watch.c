@@ -0,0 +1,427 @@
+// watch.c
+// Watch mode: checks every .x25a file under a directory once, then uses
+// inotify to recheck only the files that change. The token stream and
+// diagnostics of every other file stay in memory, so the work after a save
+// depends on what was saved, not on the size of the tree.
+// Usage: ./watch [-q ms] [-o outdir] dir
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "check.h"
+
+#define QUIET_MS 50         // a burst of saves ends after this long without events
+#define MAX_DELAY_MS 1000   // recheck anyway if the events never stop
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                    IN_DELETE_SELF | IN_ONLYDIR)
+
+typedef struct File {
+    char* path;
+    uint64_t hash;          // of the source the result was computed from
+    int checked;            // res is valid
+    int dirty;              // on the dirty list
+    CheckResult res;
+    struct File* next;      // hash chain
+    struct File* next_dirty;
+} File;
+
+static File** table;
+static size_t nbuckets = 1024;
+static size_t nfiles;
+static size_t nfailing;     // files whose last check was not CHECK_OK
+
+static File* dirty;
+static size_t ndirty;
+static long long dirty_since;
+
+static int ifd = -1;
+static char** wd_paths;     // watch descriptor -> directory
+static int wd_cap;
+
+static const char* outdir;
+static size_t root_len;     // paths in the table start with the root and a slash
+
+static uint64_t fnv1a(const char* s, size_t n) {
+    uint64_t h = 1469598103934665603ull;
+    for(size_t i = 0; i < n; i++){
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void* xmalloc(size_t n) {
+    void* p = malloc(n);
+    if(!p){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+    return p;
+}
+
+static char* join_path(const char* dir, const char* name) {
+    size_t a = strlen(dir), b = strlen(name);
+    char* p = xmalloc(a + b + 2);
+    memcpy(p, dir, a);
+    p[a] = '/';
+    memcpy(p + a + 1, name, b + 1);
+    return p;
+}
+
+static int is_source(const char* name) {
+    size_t n = strlen(name);
+    return n > 5 && strcmp(name + n - 5, ".x25a") == 0;
+}
+
+/* --- File table --- */
+static File** bucket(const char* path) {
+    return &table[fnv1a(path, strlen(path)) & (nbuckets - 1)];
+}
+
+static void grow_table() {
+    size_t old = nbuckets;
+    File** prev = table;
+    nbuckets *= 2;
+    table = calloc(nbuckets, sizeof(File*));
+    if(!table){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+    for(size_t i = 0; i < old; i++){
+        for(File* f = prev[i]; f; ){
+            File* next = f->next;
+            File** b = bucket(f->path);
+            f->next = *b;
+            *b = f;
+            f = next;
+        }
+    }
+    free(prev);
+}
+
+static File* file_get(const char* path) {
+    for(File* f = *bucket(path); f; f = f->next)
+        if(strcmp(f->path, path) == 0) return f;
+    if(nfiles >= nbuckets) grow_table();
+    File* f = calloc(1, sizeof(File));
+    if(!f){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+    f->path = strdup(path);
+    File** b = bucket(path);
+    f->next = *b;
+    *b = f;
+    nfiles++;
+    return f;
+}
+
+static void file_drop(File* f) {
+    for(File** p = bucket(f->path); *p; p = &(*p)->next){
+        if(*p == f){
+            *p = f->next;
+            break;
+        }
+    }
+    if(f->checked && f->res.status != CHECK_OK) nfailing--;
+    check_result_free(&f->res);
+    free(f->path);
+    free(f);
+    nfiles--;
+}
+
+static void mark_dirty(const char* path) {
+    File* f = file_get(path);
+    if(f->dirty) return;
+    f->dirty = 1;
+    f->next_dirty = dirty;
+    dirty = f;
+    if(ndirty++ == 0) dirty_since = now_ms();
+}
+
+// Everything at or below `dir`, for directories that went away as a whole
+static void mark_dirty_under(const char* dir) {
+    size_t n = strlen(dir);
+    for(size_t i = 0; i < nbuckets; i++)
+        for(File* f = table[i]; f; f = f->next)
+            if(strncmp(f->path, dir, n) == 0 && f->path[n] == '/') mark_dirty(f->path);
+}
+
+/* --- inotify --- */
+static void add_tree(const char* dir) {
+    int wd = inotify_add_watch(ifd, dir, WATCH_MASK);
+    if(wd < 0){
+        fprintf(stderr, "Error: Cannot watch '%s': %s\n", dir, strerror(errno));
+        return;
+    }
+    if(wd >= wd_cap){
+        int cap = wd_cap ? wd_cap : 64;
+        while(cap <= wd) cap *= 2;
+        char** p = realloc(wd_paths, sizeof(char*) * cap);
+        if(!p){ fprintf(stderr, "Error: out of memory\n"); exit(1); }
+        memset(p + wd_cap, 0, sizeof(char*) * (cap - wd_cap));
+        wd_paths = p;
+        wd_cap = cap;
+    }
+    free(wd_paths[wd]);
+    wd_paths[wd] = strdup(dir);
+
+    DIR* d = opendir(dir);
+    if(!d) return;
+    struct dirent* e;
+    while((e = readdir(d))){
+        if(e->d_name[0] == '.') continue;
+        char* path = join_path(dir, e->d_name);
+        int type = e->d_type;
+        if(type == DT_UNKNOWN){
+            struct stat st;
+            if(lstat(path, &st) == 0) type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if(type == DT_DIR) add_tree(path);
+        else if(type == DT_REG && is_source(e->d_name)) mark_dirty(path);
+        free(path);
+    }
+    closedir(d);
+}
+
+// A directory moved out of the tree keeps its watches; drop them
+static void unwatch_under(const char* dir) {
+    size_t n = strlen(dir);
+    for(int wd = 0; wd < wd_cap; wd++){
+        if(wd_paths[wd] && strncmp(wd_paths[wd], dir, n) == 0 &&
+           (wd_paths[wd][n] == '/' || wd_paths[wd][n] == 0))
+            inotify_rm_watch(ifd, wd);
+    }
+}
+
+static void rescan(const char* root) {
+    for(size_t i = 0; i < nbuckets; i++)
+        for(File* f = table[i]; f; f = f->next) mark_dirty(f->path);
+    add_tree(root);
+}
+
+static void handle_events(const char* root) {
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for(;;){
+        ssize_t n = read(ifd, buf, sizeof(buf));
+        if(n <= 0) return;     // drained (non-blocking)
+        for(char* p = buf; p < buf + n; ){
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(*ev) + ev->len;
+
+            if(ev->mask & IN_Q_OVERFLOW){
+                fprintf(stderr, "[watch] event queue overflowed, rescanning\n");
+                rescan(root);
+                continue;
+            }
+            if(ev->wd < 0 || ev->wd >= wd_cap || !wd_paths[ev->wd]) continue;
+            if(ev->mask & IN_IGNORED){
+                free(wd_paths[ev->wd]);
+                wd_paths[ev->wd] = NULL;
+                continue;
+            }
+            if(ev->len == 0) continue;
+
+            char* path = join_path(wd_paths[ev->wd], ev->name);
+            if(ev->mask & IN_ISDIR){
+                if(ev->mask & (IN_CREATE | IN_MOVED_TO)) add_tree(path);
+                if(ev->mask & (IN_DELETE | IN_MOVED_FROM)){
+                    unwatch_under(path);
+                    mark_dirty_under(path);
+                }
+            } else if(is_source(ev->name)){
+                mark_dirty(path);
+            }
+            free(path);
+        }
+    }
+}
+
+/* --- Checking --- */
+static char* read_source(const char* path, size_t* len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return NULL;
+    struct stat st;
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)){
+        close(fd);
+        return NULL;
+    }
+    char* data = xmalloc(st.st_size + 1);
+    size_t got = 0;
+    ssize_t r = 0;
+    while(got < (size_t)st.st_size && (r = read(fd, data + got, st.st_size - got)) > 0) got += r;
+    close(fd);
+    if(r < 0){
+        free(data);
+        return NULL;
+    }
+    *len = got;
+    return data;
+}
+
+// outdir mirrors the tree, so files with the same name in different
+// directories get different token files
+static int tokens_path(const File* f, char* out, size_t size) {
+    const char* rel = f->path + root_len + 1;
+    int n = snprintf(out, size, "%s/%.*s.lex", outdir, (int)(strlen(rel) - 5), rel);
+    return n > 0 && (size_t)n < size;
+}
+
+static void write_tokens(const File* f) {
+    char out[PATH_MAX];
+    if(!tokens_path(f, out, sizeof(out))) return;
+    for(char* p = out + strlen(outdir) + 1; (p = strchr(p, '/')); p++){
+        *p = 0;
+        mkdir(out, 0777);
+        *p = '/';
+    }
+    FILE* o = fopen(out, "w");
+    if(!o){
+        fprintf(stderr, "Error: Cannot open '%s'\n", out);
+        perror("fopen");
+        return;
+    }
+    fwrite(f->res.tokens, 1, f->res.tokens_len, o);
+    fclose(o);
+}
+
+// Output of a file that was removed or no longer lexes would be stale
+static void remove_tokens(const File* f) {
+    char out[PATH_MAX];
+    if(tokens_path(f, out, sizeof(out))) unlink(out);
+}
+
+static void report(const File* f, int verbose) {
+    if(!f->checked) return;
+    if(f->res.status == CHECK_OK){
+        if(verbose) fprintf(stderr, "── %s: ok\n", f->path);
+        return;
+    }
+    fprintf(stderr, "── %s: %d lexer / %d parser errors\n", f->path, f->res.lex_errors,
+            f->res.parse_errors > 0 ? f->res.parse_errors : 0);
+    fwrite(f->res.diag, 1, f->res.diag_len, stderr);
+}
+
+// Rechecks the dirty files whose contents changed since their last check
+static void flush_dirty(int verbose) {
+    long long start = now_ms();
+    int rechecked = 0, removed = 0;
+    File* list = dirty;
+    dirty = NULL;
+    ndirty = 0;
+
+    while(list){
+        File* f = list;
+        list = f->next_dirty;
+        f->dirty = 0;
+
+        size_t len;
+        char* src = read_source(f->path, &len);
+        if(!src){
+            if(errno == ENOENT || errno == ENOTDIR){
+                if(f->checked && verbose) fprintf(stderr, "── %s: removed\n", f->path);
+                removed += f->checked;
+                if(outdir && f->checked) remove_tokens(f);
+                file_drop(f);
+            }
+            continue;
+        }
+        uint64_t h = fnv1a(src, len);
+        if(f->checked && f->hash == h){
+            free(src);      // saved without changes
+            continue;
+        }
+
+        if(f->checked){
+            if(f->res.status != CHECK_OK) nfailing--;
+            check_result_free(&f->res);
+        }
+        check_source(src, len, &f->res);
+        free(src);
+        f->hash = h;
+        f->checked = 1;
+        if(f->res.status != CHECK_OK) nfailing++;
+        rechecked++;
+
+        report(f, verbose);
+        if(outdir && f->res.status != CHECK_FAILED) write_tokens(f);
+        else if(outdir) remove_tokens(f);
+    }
+
+    if(rechecked || removed || !verbose){
+        fprintf(stderr, "[watch] rechecked %d file%s in %lld ms, %zu file%s, %zu with errors\n",
+                rechecked, rechecked == 1 ? "" : "s", now_ms() - start,
+                nfiles, nfiles == 1 ? "" : "s", nfailing);
+    }
+}
+
+int main(int argc, char** argv){
+    int quiet = QUIET_MS;
+    int opt;
+    while((opt = getopt(argc, argv, "q:o:")) != -1){
+        switch(opt){
+            case 'q': quiet = atoi(optarg); break;
+            case 'o': outdir = optarg; break;
+            default: goto usage;
+        }
+    }
+    if(optind >= argc || quiet < 0) goto usage;
+
+    // the root is kept as given so reported paths look like the argument
+    char root[PATH_MAX];
+    snprintf(root, sizeof(root), "%s", argv[optind]);
+    size_t rl = strlen(root);
+    while(rl > 1 && root[rl - 1] == '/') root[--rl] = 0;
+    root_len = rl;
+
+    table = calloc(nbuckets, sizeof(File*));
+    ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(!table || ifd < 0){
+        perror("inotify_init1");
+        return 1;
+    }
+    if(outdir) mkdir(outdir, 0777);
+
+    add_tree(root);
+    if(!wd_paths){
+        fprintf(stderr, "Error: Cannot watch '%s'\n", root);
+        return 1;
+    }
+    flush_dirty(0);
+    fprintf(stderr, "[watch] watching %s\n", root);
+
+    for(;;){
+        int timeout = -1;
+        if(ndirty){
+            long long left = dirty_since + MAX_DELAY_MS - now_ms();
+            timeout = left < quiet ? (left > 0 ? (int)left : 0) : quiet;
+        }
+        struct pollfd p = { .fd = ifd, .events = POLLIN };
+        int r = poll(&p, 1, timeout);
+        if(r < 0){
+            if(errno == EINTR) continue;
+            perror("poll");
+            return 1;
+        }
+        if(r > 0){
+            handle_events(root);
+            if(now_ms() - dirty_since < MAX_DELAY_MS) continue;   // wait for the burst to end
+        }
+        if(ndirty) flush_dirty(1);
+    }
+
+usage:
+    fprintf(stderr, "Usage: %s [-q ms] [-o outdir] dir\n", argv[0]);
+    fprintf(stderr, "  dir: checked recursively, every .x25a file is lexed and parsed\n");
+    fprintf(stderr, "  -q: wait for this many ms without changes before rechecking (default %d)\n", QUIET_MS);
+    fprintf(stderr, "  -o: also write the token stream of every checked file to outdir/<path>.lex\n");
+    return 1;
+}